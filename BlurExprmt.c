@@ -5,41 +5,86 @@
 #include "Picture.h"
 #include "PicProcess.h"
 #include "Thpool.h"
-#include <sys/time.h>
+#include "BlurKernel.h"
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
 
-#define BLUR_REGION_SIZE 9
 #define TEST_ITERATIONS 6
+#define WARMUP_ITERATIONS 1
+#define NANOS_PER_MILLI 1e6
+#define MAX_THREAD_COUNTS 64
+#define NO_RGB_COMPONENTS 3
+#define DEFAULT_L1_CACHE_SIZE (32 * 1024)
+#define DEFAULT_L2_CACHE_SIZE (256 * 1024)
 #define max(a, b) ((a) > (b) ? (a) : (b))
+#define min(a, b) ((a) < (b) ? (a) : (b))
 
-struct col_blurring_task_args {
+struct blurring_task_args {
   struct picture *pic;
   struct picture *tmp;
-  int col;
 };
 
-struct row_blurring_task_args {
+struct sector_blurring_task_args {
   struct picture *pic;
   struct picture *tmp;
-  int row;
+  int width_sector_size;
+  int heigth_sector_size;
+  int heigth_sector_number;
 };
 
-struct sector_blurring_task_args {
+struct tile_blurring_task_args {
   struct picture *pic;
   struct picture *tmp;
-  int width_start;
-  int heigth_start;
-  int width_sector_size;
-  int heigth_sector_size;
+  int tile_width;
+  int tile_height;
+  int width_tile_number;
+};
+
+// summary of the timed iterations of one benchmark run (in nanoseconds)
+struct bench_stats {
+  long long min;
+  long long median;
+  long long p95;
+  double mean;
+  double stddev;
+};
+
+// one benchmark run of a strategy at a thread count
+struct bench_result {
+  const char *process;
+  int threads;
+  struct bench_stats stats;
 };
 
-static void pixel_blur(struct picture *pic, struct picture *tmp, int a, int b);
+// tile size used by tiled_blur, 0 picks it from the cache sizes
+static int tile_width = 0;
+static int tile_height = 0;
+
+static void span_blur(struct picture *pic, struct picture *tmp, int b, int a_start, int a_end);
 static long long get_curr_time();
-static void col_blurring_task(void *args_ptr);
+static void run_benchmark(void (*cmd)(struct picture *), struct picture *input, struct picture *output,
+                          int warmup, int iterations, struct bench_stats *stats);
+static int compare_samples(const void *a, const void *b);
+static void compute_stats(long long *samples, int count, struct bench_stats *stats);
+static int parse_thread_counts(const char *list, int *counts);
+static int run_thread_sweep(struct picture *pic, struct picture *output, int cmd_no, int *thread_counts,
+                            int thread_count_number, int warmup, int iterations, struct bench_result *results);
+static void print_sweep_row(struct bench_result *result, struct bench_result *baseline);
+static void write_csv(const char *path, const char *image, struct picture *pic, int warmup, int iterations,
+                      struct bench_result *results, int result_count);
+static void write_json_string(FILE *file, const char *str);
+static void write_json(const char *path, const char *image, struct picture *pic, int warmup, int iterations,
+                       struct bench_result *results, int result_count);
+static void col_blurring_task(int col_start, int col_end, void *args_ptr);
 static void parallel_col_blur(struct picture *pic);
-static void row_blurring_task(void *args_ptr);
+static void row_blurring_task(int row_start, int row_end, void *args_ptr);
 static void parallel_row_blur(struct picture *pic);
-static void sector_blurring_task(void *args_ptr);
+static void sector_blurring_task(int sector_start, int sector_end, void *args_ptr);
 static void parallel_sector_blur(struct picture *pic);
+static void tile_blurring_task(int tile_start, int tile_end, void *args_ptr);
+static void choose_tile_size(struct picture *pic, int *width, int *height);
+static void tiled_blur(struct picture *pic);
 static void blur_picture_wrapped(struct picture *pic);
 static void parallel_blur_picture_wrapped (struct picture *pic);
 
@@ -50,7 +95,8 @@ static void parallel_blur_picture_wrapped (struct picture *pic);
     parallel_col_blur,
     parallel_blur_picture_wrapped,
     blur_picture_wrapped,
-    parallel_sector_blur
+    parallel_sector_blur,
+    tiled_blur
   };
 
   // list of all possible picture transformations
@@ -59,7 +105,8 @@ static void parallel_blur_picture_wrapped (struct picture *pic);
     "parallel_col_blur",
     "parallel_pixel_blur",
     "blur_picture",
-    "parallel_sector_blur"
+    "parallel_sector_blur",
+    "tiled_blur"
   };
 
   // size of look-up table (for safe IO error reporting)
@@ -85,6 +132,47 @@ static void parallel_blur_picture_wrapped (struct picture *pic);
     printf("  target    = %s\n", target_file);
     printf("  process   = %s\n", process);
 
+    // optional settings following the positional arguments
+    int iterations = TEST_ITERATIONS;
+    int warmup = WARMUP_ITERATIONS;
+    const char *csv_file = NULL;
+    const char *json_file = NULL;
+    int thread_counts[MAX_THREAD_COUNTS];
+    int thread_count_number = 0;
+    for (int arg = 4; arg < argc; arg++) {
+      if (!strcmp(argv[arg], "--iterations") && arg + 1 < argc) {
+        iterations = atoi(argv[++arg]);
+        if (iterations < 1) {
+          printf("[!] invalid number of iterations %s (must be at least 1)\n", argv[arg]);
+          exit(IO_ERROR);
+        }
+      } else if (!strcmp(argv[arg], "--warmup") && arg + 1 < argc) {
+        warmup = atoi(argv[++arg]);
+        if (warmup < 0) {
+          printf("[!] invalid number of warmup runs %s\n", argv[arg]);
+          exit(IO_ERROR);
+        }
+      } else if (!strcmp(argv[arg], "--threads") && arg + 1 < argc) {
+        thread_count_number = parse_thread_counts(argv[++arg], thread_counts);
+        if (thread_count_number == 0) {
+          printf("[!] invalid thread counts %s (expecting a list like 1,2,4,8)\n", argv[arg]);
+          exit(IO_ERROR);
+        }
+      } else if (!strcmp(argv[arg], "--csv") && arg + 1 < argc) {
+        csv_file = argv[++arg];
+      } else if (!strcmp(argv[arg], "--json") && arg + 1 < argc) {
+        json_file = argv[++arg];
+      } else if (!strcmp(argv[arg], "--tile") && arg + 1 < argc) {
+        arg++;
+        if (sscanf(argv[arg], "%dx%d", &tile_width, &tile_height) != 2 || tile_width < 0 || tile_height < 0) {
+          printf("[!] invalid tile size %s (expecting WIDTHxHEIGHT, 0x0 for auto)\n", argv[arg]);
+          exit(IO_ERROR);
+        }
+      } else {
+        printf("[!] unknown option %s\n", argv[arg]);
+        exit(IO_ERROR);
+      }
+    }
 
     // create original image object
     struct picture pic;
@@ -92,128 +180,124 @@ static void parallel_blur_picture_wrapped (struct picture *pic);
       exit(IO_ERROR);   
     }   
 
-    // identify the picture transformation to run
+    // identify the picture transformation to run ("all" sweeps every strategy)
     int cmd_no = 0;
-    while(cmd_no < no_of_cmds && strcmp(process, cmd_strings[cmd_no])){
-      cmd_no++;
+    if (thread_count_number > 0 && !strcmp(process, "all")) {
+      cmd_no = -1;
+    } else {
+      while(cmd_no < no_of_cmds && strcmp(process, cmd_strings[cmd_no])){
+        cmd_no++;
+      }
+
+      // IO error check
+      if(cmd_no == no_of_cmds) {
+        printf("[!] invalid process requested: %s is not defined\n    aborting...\n", process);  
+        exit(IO_ERROR);   
+      }
     }
+  
+    printf("  kernel    = %s\n", blur_kernel_name());
+    printf("  runs      = %d (+%d warmup)\n", iterations, warmup);
 
-    // IO error check
-    if(cmd_no == no_of_cmds) {
-      printf("[!] invalid process requested: %s is not defined\n    aborting...\n", process);  
-      exit(IO_ERROR);   
+    // room for the baseline plus every strategy at every thread count
+    struct bench_result *results = malloc((1 + no_of_cmds * max(thread_count_number, 1)) * sizeof(struct bench_result));
+    if (results == NULL) {
+      printf("[!] could not allocate benchmark memory\n");
+      exit(IO_ERROR);
     }
-  
-    // dispatch to appropriate picture transformation function
-    int time_sum = 0;
-    for (int iteration = 0; iteration < TEST_ITERATIONS; iteration++) {
-      printf("Iteration %d is running\n", iteration);
-      long long start = get_curr_time();
-      cmds[cmd_no](&pic);
-      long long end = get_curr_time();
-      time_sum += end - start;
+    int result_count;
+
+    struct picture blurred;
+    if (thread_count_number == 0) {
+      // dispatch to appropriate picture transformation function on the process-wide pool
+      results[0].process = cmd_strings[cmd_no];
+      results[0].threads = thpool_num_threads(thpool_global());
+      printf("  threads   = %d\n", results[0].threads);
+      run_benchmark(cmds[cmd_no], &pic, &blurred, warmup, iterations, &results[0].stats);
+      result_count = 1;
+
+      struct bench_stats *stats = &results[0].stats;
+      printf("-- Picture has been blurred in min %.3f / median %.3f / p95 %.3f milliseconds "
+             "(mean %.3f, stddev %.3f)\n",
+             stats->min / NANOS_PER_MILLI, stats->median / NANOS_PER_MILLI, stats->p95 / NANOS_PER_MILLI,
+             stats->mean / NANOS_PER_MILLI, stats->stddev / NANOS_PER_MILLI);
+    } else {
+      // run the strategies on pools of each size against the sequential baseline
+      result_count = run_thread_sweep(&pic, &blurred, cmd_no, thread_counts, thread_count_number,
+                                      warmup, iterations, results);
     }
 
-    int average = time_sum / TEST_ITERATIONS;
-
     // save resulting picture and report success
-    save_picture_to_file(&pic, target_file);
-    printf("-- Picture has been blurred with an average of %d milliseconds\n", average);
+    save_picture_to_file(&blurred, target_file, NULL);
+
+    if (csv_file != NULL) {
+      write_csv(csv_file, filename, &pic, warmup, iterations, results, result_count);
+    }
+    if (json_file != NULL) {
+      write_json(json_file, filename, &pic, warmup, iterations, results, result_count);
+    }
     
+    free(results);
+    clear_picture(&blurred);
     clear_picture(&pic);
+    thpool_global_shutdown();
     return 0;
   }
 
 static void parallel_col_blur(struct picture *pic) {
   // make temporary copy of picture to work from
   struct picture tmp;
-  tmp.img = copy_image(pic->img);
-  tmp.width = pic->width;
-  tmp.height = pic->height;  
+  copy_picture(&tmp, pic);
   
-  threadpool thpool = thpool_init(pic->width - 2);
+  struct blurring_task_args args = { pic, &tmp };
 
-  // iterate over each column in the picture (ignoring boundary pixels)
-  for(int b = 1 ; b < tmp.width - 1; b++) {
-    struct col_blurring_task_args *params = (struct col_blurring_task_args*) malloc(sizeof(struct col_blurring_task_args)); 
-    params->pic = pic;
-    params->tmp = &tmp;
-    params->col = b;
-
-    thpool_add_work(thpool, (void *) col_blurring_task, (void *) params);
-  }
-        
-  thpool_wait(thpool);
-  thpool_destroy(thpool);  
+  // split the columns of the picture (ignoring boundary pixels) across the pool
+  thpool_parallel_for(get_picture_threadpool(), 1, tmp.width - 1, 1, col_blurring_task, &args);
 
   // temporary picture clean-up
   clear_picture(&tmp);
 }
 
-static void col_blurring_task(void *args_ptr) {
-  struct col_blurring_task_args *args = (struct col_blurring_task_args *) args_ptr;
-  struct picture *pic = (struct picture *) args->pic;
-  struct picture *tmp = (struct picture *) args->tmp;
-  int col = (int) args->col;
+static void col_blurring_task(int col_start, int col_end, void *args_ptr) {
+  struct blurring_task_args *args = (struct blurring_task_args *) args_ptr;
+  struct picture *pic = args->pic;
+  struct picture *tmp = args->tmp;
 
-  int col_end = tmp->height - 1;
-  for (int b = 1; b < col_end; b++) {
-    pixel_blur(pic, tmp, col, b);
+  int col_length = tmp->height - 1;
+  for (int b = 1; b < col_length; b++) {
+    span_blur(pic, tmp, b, col_start, col_end);
   }
-
-  free(args);
 }
 
 static void parallel_row_blur(struct picture *pic) {
   // make temporary copy of picture to work from
   struct picture tmp;
-  tmp.img = copy_image(pic->img);
-  tmp.width = pic->width;
-  tmp.height = pic->height;  
-
-  threadpool thpool = thpool_init(pic->height - 2);
-
-  // iterate over each row in the picture (ignoring boundary pixels)
-  for(int a = 1 ; a < tmp.height - 1; a++) {
-    struct row_blurring_task_args *params = (struct row_blurring_task_args*) malloc(sizeof(struct row_blurring_task_args)); 
-    params->pic = pic;
-    params->tmp = &tmp;
-    params->row = a;
-    
-    thpool_add_work(thpool, (void *) row_blurring_task, (void *) params);
-  }
+  copy_picture(&tmp, pic);
+
+  struct blurring_task_args args = { pic, &tmp };
 
-  thpool_wait(thpool);
-  thpool_destroy(thpool);  
+  // split the rows of the picture (ignoring boundary pixels) across the pool
+  thpool_parallel_for(get_picture_threadpool(), 1, tmp.height - 1, 1, row_blurring_task, &args);
 
   // temporary picture clean-up
   clear_picture(&tmp);  
 }
 
-static void row_blurring_task(void *args_ptr) {
-  struct row_blurring_task_args *args = (struct row_blurring_task_args *) args_ptr;
-  struct picture *pic = (struct picture *) args->pic;
-  struct picture *tmp = (struct picture *) args->tmp;
-  int row = (int) args->row;
+static void row_blurring_task(int row_start, int row_end, void *args_ptr) {
+  struct blurring_task_args *args = (struct blurring_task_args *) args_ptr;
+  struct picture *pic = args->pic;
+  struct picture *tmp = args->tmp;
 
-  int row_end = tmp->width - 1;
-  for (int a = 1; a < row_end; a++) {
-    pixel_blur(pic, tmp, a, row);
+  int row_length = tmp->width - 1;
+  for (int b = row_start; b < row_end; b++) {
+    span_blur(pic, tmp, b, 1, row_length);
   }
-
-  free(args);
 }
 
 static void parallel_sector_blur(struct picture *pic) {
   // make temporary copy of picture to work from
   struct picture tmp;
-  tmp.img = copy_image(pic->img);
-  tmp.width = pic->width;
-  tmp.height = pic->height;  
-
-  int max_sector_number = 8;
-
-  threadpool thpool = thpool_init(max_sector_number);
+  copy_picture(&tmp, pic);
 
   int width_sector_size;
   int heigth_sector_size;
@@ -225,75 +309,326 @@ static void parallel_sector_blur(struct picture *pic) {
     width_sector_size = max(tmp.width / 2, 1);
   }
 
-  // iterate over each sector in the picture (ignoring boundary pixels)
-  for (int a = 1; a < tmp.width - 1; a += width_sector_size) {
-    for (int b = 1; b < tmp.height - 1; b += heigth_sector_size) {
-      struct sector_blurring_task_args *params = (struct sector_blurring_task_args*) malloc(sizeof(struct sector_blurring_task_args)); 
-      params->pic = pic;
-      params->tmp = &tmp;
-      params->width_start = a;
-      params->heigth_start = b;
-      params->width_sector_size = width_sector_size;
-      params->heigth_sector_size = heigth_sector_size;
-      
-      thpool_add_work(thpool, (void *) sector_blurring_task, (void *) params);
-    }
-  }
+  // number the sectors (ignoring boundary pixels) column by column
+  int width_sector_number = (max(tmp.width - 2, 0) + width_sector_size - 1) / width_sector_size;
+  int heigth_sector_number = (max(tmp.height - 2, 0) + heigth_sector_size - 1) / heigth_sector_size;
 
-  thpool_wait(thpool);
-  thpool_destroy(thpool);  
+  struct sector_blurring_task_args args = {
+    pic, &tmp, width_sector_size, heigth_sector_size, heigth_sector_number
+  };
+
+  // hand out one sector per chunk
+  thpool_parallel_for(get_picture_threadpool(), 0, width_sector_number * heigth_sector_number, 1,
+                      sector_blurring_task, &args);
 
   // temporary picture clean-up
   clear_picture(&tmp);  
 }
 
-static void sector_blurring_task(void *args_ptr) {
+static void sector_blurring_task(int sector_start, int sector_end, void *args_ptr) {
   struct sector_blurring_task_args *args = (struct sector_blurring_task_args *) args_ptr;
-  struct picture *pic = (struct picture *) args->pic;
-  struct picture *tmp = (struct picture *) args->tmp;
-  int width_start = (int) args->width_start;
-  int heigth_start = (int) args->heigth_start;
-  int width_sector_size = (int) args->width_sector_size;
-  int heigth_sector_size = (int) args->heigth_sector_size;
-
-  for (int a = width_start; a < width_start + width_sector_size && a < tmp->width - 1; a++) {
+  struct picture *pic = args->pic;
+  struct picture *tmp = args->tmp;
+  int width_sector_size = args->width_sector_size;
+  int heigth_sector_size = args->heigth_sector_size;
+
+  for (int sector = sector_start; sector < sector_end; sector++) {
+    int width_start = 1 + (sector / args->heigth_sector_number) * width_sector_size;
+    int heigth_start = 1 + (sector % args->heigth_sector_number) * heigth_sector_size;
+
+    int width_end = width_start + width_sector_size < tmp->width - 1 ? width_start + width_sector_size : tmp->width - 1;
     for (int b = heigth_start; b < heigth_start + heigth_sector_size && b < tmp->height - 1; b++) {
-      pixel_blur(pic, tmp, a, b);
+      span_blur(pic, tmp, b, width_start, width_end);
     }
   }
+}
+
+static void tiled_blur(struct picture *pic) {
+  // make temporary copy of picture to work from
+  struct picture tmp;
+  copy_picture(&tmp, pic);
+
+  int width;
+  int height;
+  choose_tile_size(&tmp, &width, &height);
+
+  // number the tiles (ignoring boundary pixels) row by row, so that tiles
+  // handed out next to each other share their halo rows
+  int width_tile_number = (max(tmp.width - 2, 0) + width - 1) / width;
+  int heigth_tile_number = (max(tmp.height - 2, 0) + height - 1) / height;
 
-  free(args);
+  struct tile_blurring_task_args args = { pic, &tmp, width, height, width_tile_number };
+
+  // hand out one tile per chunk
+  thpool_parallel_for(get_picture_threadpool(), 0, width_tile_number * heigth_tile_number, 1,
+                      tile_blurring_task, &args);
+
+  // temporary picture clean-up
+  clear_picture(&tmp);
 }
 
-static void pixel_blur(struct picture *pic, struct picture *tmp, int a, int b) {
-  // set-up a local pixel on the stack
-  struct pixel rgb;  
-  int sum_red = 0;
-  int sum_green = 0;
-  int sum_blue = 0;
-  
-  // check the surrounding pixel region
-  for(int n = -1; n <= 1; n++){
-    for(int m = -1; m <= 1; m++){
-      rgb = get_pixel(tmp, a+n, b+m);
-      sum_red += rgb.red;
-      sum_green += rgb.green;
-      sum_blue += rgb.blue;
+static void tile_blurring_task(int tile_start, int tile_end, void *args_ptr) {
+  struct tile_blurring_task_args *args = (struct tile_blurring_task_args *) args_ptr;
+  struct picture *pic = args->pic;
+  struct picture *tmp = args->tmp;
+
+  for (int tile = tile_start; tile < tile_end; tile++) {
+    int width_start = 1 + (tile % args->width_tile_number) * args->tile_width;
+    int heigth_start = 1 + (tile / args->width_tile_number) * args->tile_height;
+    int width_end = min(width_start + args->tile_width, tmp->width - 1);
+    int heigth_end = min(heigth_start + args->tile_height, tmp->height - 1);
+
+    for (int b = heigth_start; b < heigth_end; b++) {
+      span_blur(pic, tmp, b, width_start, width_end);
     }
   }
+}
+
+/* picks the tile size for tiled_blur, either from --tile or from the cache sizes */
+static void choose_tile_size(struct picture *pic, int *width, int *height) {
+  long l1_size = 0;
+  long l2_size = 0;
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+  l1_size = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+#endif
+#ifdef _SC_LEVEL2_CACHE_SIZE
+  l2_size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+  if (l1_size <= 0) {
+    l1_size = DEFAULT_L1_CACHE_SIZE;
+  }
+  if (l2_size <= 0) {
+    l2_size = DEFAULT_L2_CACHE_SIZE;
+  }
+
+  // the three source rows and the output row of a tile should stay in half of L1
+  *width = tile_width;
+  if (*width == 0) {
+    *width = max(l1_size / 2 / (4 * NO_RGB_COMPONENTS), 16);
+  }
+  *width = min(*width, max(pic->width - 2, 1));
 
-  // compute average pixel RGB value
-  rgb.red = sum_red / BLUR_REGION_SIZE;
-  rgb.green = sum_green / BLUR_REGION_SIZE;
-  rgb.blue = sum_blue / BLUR_REGION_SIZE;
-  // set pixel to region average RBG value
-  set_pixel(pic, a, b, &rgb);
+  // the source and output of a whole tile should stay in half of L2
+  *height = tile_height;
+  if (*height == 0) {
+    *height = max(l2_size / 2 / (2 * NO_RGB_COMPONENTS * *width), 4);
+  }
+  *height = min(*height, max(pic->height - 2, 1));
+}
+
+/* blurs the pixels [a_start, a_end) of row b with the 3x3 kernel */
+static void span_blur(struct picture *pic, struct picture *tmp, int b, int a_start, int a_end) {
+  blur_row_3x3(picture_row(pic, b), picture_row(tmp, b - 1), picture_row(tmp, b),
+               picture_row(tmp, b + 1), a_start, a_end);
 }
 
 static long long get_curr_time() {
-  struct timeval time;
-  gettimeofday(&time, NULL);
-  return time.tv_sec * 1000LL + time.tv_usec / 1000; 
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec * 1000000000LL + time.tv_nsec; 
+}
+
+/* times cmd on a fresh copy of input per run, leaving the last result in output */
+static void run_benchmark(void (*cmd)(struct picture *), struct picture *input, struct picture *output,
+                          int warmup, int iterations, struct bench_stats *stats) {
+  long long *samples = malloc(iterations * sizeof(long long));
+  if (samples == NULL || !init_picture_from_size(output, input->width, input->height)) {
+    printf("[!] could not allocate benchmark memory\n");
+    exit(IO_ERROR);
+  }
+
+  size_t size = (size_t) input->width * input->height * NO_RGB_COMPONENTS;
+  for (int iteration = -warmup; iteration < iterations; iteration++) {
+    // restore the input outside of the timed region
+    memcpy(output->data, input->data, size);
+
+    long long start = get_curr_time();
+    cmd(output);
+    long long end = get_curr_time();
+
+    if (iteration >= 0) {
+      samples[iteration] = end - start;
+    }
+  }
+
+  compute_stats(samples, iterations, stats);
+  free(samples);
+}
+
+static int compare_samples(const void *a, const void *b) {
+  long long x = *(const long long *) a;
+  long long y = *(const long long *) b;
+  return (x > y) - (x < y);
+}
+
+/* min, median, nearest-rank 95th percentile, mean and sample standard deviation */
+static void compute_stats(long long *samples, int count, struct bench_stats *stats) {
+  qsort(samples, count, sizeof(long long), compare_samples);
+
+  stats->min = samples[0];
+  stats->median = count % 2 ? samples[count / 2] : (samples[count / 2 - 1] + samples[count / 2]) / 2;
+  stats->p95 = samples[(int) ceil(0.95 * count) - 1];
+
+  double sum = 0;
+  for (int i = 0; i < count; i++) {
+    sum += samples[i];
+  }
+  stats->mean = sum / count;
+
+  double squares = 0;
+  for (int i = 0; i < count; i++) {
+    squares += (samples[i] - stats->mean) * (samples[i] - stats->mean);
+  }
+  stats->stddev = count > 1 ? sqrt(squares / (count - 1)) : 0;
+}
+
+/* parses a comma separated list of positive thread counts, returns how many there are (0 on error) */
+static int parse_thread_counts(const char *list, int *counts) {
+  int number = 0;
+  const char *pos = list;
+  while (*pos != '\0') {
+    char *end;
+    long count = strtol(pos, &end, 10);
+    if (end == pos || count < 1 || number == MAX_THREAD_COUNTS || (*end != ',' && *end != '\0')) {
+      return 0;
+    }
+    counts[number++] = (int) count;
+    pos = *end == ',' ? end + 1 : end;
+  }
+  return number;
+}
+
+/* runs the strategy (all of them for cmd_no -1) with every thread count
+ * and prints the speedup over the sequential blur_picture baseline
+ *
+ * A thread count includes the calling thread, which runs chunks while it
+ * waits, so n threads means a pool of n-1 workers. */
+static int run_thread_sweep(struct picture *pic, struct picture *output, int cmd_no, int *thread_counts,
+                            int thread_count_number, int warmup, int iterations, struct bench_result *results) {
+  int result_count = 0;
+
+  // the baseline also provides the picture that gets saved
+  struct bench_result *baseline = &results[result_count++];
+  baseline->process = "blur_picture";
+  baseline->threads = 1;
+  run_benchmark(blur_picture_wrapped, pic, output, warmup, iterations, &baseline->stats);
+
+  printf("\n  %-22s %8s %12s %9s %11s\n", "strategy", "threads", "median ms", "speedup", "efficiency");
+  print_sweep_row(baseline, baseline);
+
+  for (int n = 0; n < thread_count_number; n++) {
+    threadpool thpool = thpool_init(thread_counts[n] - 1);
+    if (thpool == NULL) {
+      printf("[!] could not create a pool of %d threads\n", thread_counts[n] - 1);
+      exit(IO_ERROR);
+    }
+    set_picture_threadpool(thpool);
+
+    for (int cmd = 0; cmd < no_of_cmds; cmd++) {
+      if ((cmd_no >= 0 && cmd != cmd_no) || (cmd_no < 0 && cmds[cmd] == blur_picture_wrapped)) {
+        continue;
+      }
+
+      struct picture blurred;
+      struct bench_result *result = &results[result_count++];
+      result->process = cmd_strings[cmd];
+      result->threads = thread_counts[n];
+      run_benchmark(cmds[cmd], pic, &blurred, warmup, iterations, &result->stats);
+      clear_picture(&blurred);
+
+      print_sweep_row(result, baseline);
+    }
+
+    set_picture_threadpool(NULL);
+    thpool_destroy(thpool);
+  }
+  printf("\n");
+
+  return result_count;
+}
+
+/* prints median time, speedup and parallel efficiency of one sweep result */
+static void print_sweep_row(struct bench_result *result, struct bench_result *baseline) {
+  double speedup = (double) baseline->stats.median / result->stats.median;
+  printf("  %-22s %8d %12.3f %8.2fx %10.1f%%\n", result->process, result->threads,
+         result->stats.median / NANOS_PER_MILLI, speedup, 100.0 * speedup / result->threads);
+}
+
+/* appends one line per run to a CSV file, writing the header for a new file */
+static void write_csv(const char *path, const char *image, struct picture *pic, int warmup, int iterations,
+                      struct bench_result *results, int result_count) {
+  FILE *file = fopen(path, "a");
+  if (file == NULL) {
+    printf("[!] error writing results to %s\n", path);
+    return;
+  }
+
+  if (ftell(file) == 0) {
+    fprintf(file, "timestamp,host,image,width,height,process,kernel,threads,warmup,iterations,"
+                  "min_ns,median_ns,p95_ns,mean_ns,stddev_ns\n");
+  }
+
+  char host[256] = "unknown";
+  gethostname(host, sizeof(host) - 1);
+  for (int i = 0; i < result_count; i++) {
+    struct bench_stats *stats = &results[i].stats;
+    fprintf(file, "%ld,%s,%s,%d,%d,%s,%s,%d,%d,%d,%lld,%lld,%lld,%.0f,%.0f\n",
+            (long) time(NULL), host, image, pic->width, pic->height, results[i].process, blur_kernel_name(),
+            results[i].threads, warmup, iterations, stats->min, stats->median, stats->p95, stats->mean,
+            stats->stddev);
+  }
+  fclose(file);
+}
+
+/* writes a JSON string literal, escaping what needs to be escaped */
+static void write_json_string(FILE *file, const char *str) {
+  fputc('"', file);
+  for (; *str; str++) {
+    if (*str == '"' || *str == '\\') {
+      fprintf(file, "\\%c", *str);
+    } else if ((unsigned char) *str < 0x20) {
+      fprintf(file, "\\u%04x", *str);
+    } else {
+      fputc(*str, file);
+    }
+  }
+  fputc('"', file);
+}
+
+/* writes the runs as a JSON document */
+static void write_json(const char *path, const char *image, struct picture *pic, int warmup, int iterations,
+                       struct bench_result *results, int result_count) {
+  FILE *file = fopen(path, "w");
+  if (file == NULL) {
+    printf("[!] error writing results to %s\n", path);
+    return;
+  }
+
+  char host[256] = "unknown";
+  gethostname(host, sizeof(host) - 1);
+  fprintf(file, "{\n");
+  fprintf(file, "  \"timestamp\": %ld,\n", (long) time(NULL));
+  fprintf(file, "  \"host\": ");
+  write_json_string(file, host);
+  fprintf(file, ",\n  \"image\": ");
+  write_json_string(file, image);
+  fprintf(file, ",\n");
+  fprintf(file, "  \"width\": %d,\n", pic->width);
+  fprintf(file, "  \"height\": %d,\n", pic->height);
+  fprintf(file, "  \"kernel\": \"%s\",\n", blur_kernel_name());
+  fprintf(file, "  \"warmup\": %d,\n", warmup);
+  fprintf(file, "  \"iterations\": %d,\n", iterations);
+  fprintf(file, "  \"results\": [\n");
+  for (int i = 0; i < result_count; i++) {
+    struct bench_stats *stats = &results[i].stats;
+    fprintf(file, "    {\"process\": \"%s\", \"threads\": %d, \"min_ns\": %lld, \"median_ns\": %lld, "
+                  "\"p95_ns\": %lld, \"mean_ns\": %.0f, \"stddev_ns\": %.0f}%s\n",
+            results[i].process, results[i].threads, stats->min, stats->median, stats->p95, stats->mean,
+            stats->stddev, i + 1 < result_count ? "," : "");
+  }
+  fprintf(file, "  ]\n");
+  fprintf(file, "}\n");
+  fclose(file);
 }
 
 /* wrapper for the parallel_blur_picture function in PicProcess.c */
@@ -0,0 +1,124 @@
+#include "BlurKernel.h"
+#include <pthread.h>
+#include <stddef.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BLUR_KERNEL_X86 1
+#endif
+
+  // bytes per pixel (interleaved RGB), also the distance to the horizontal neighbours
+  #define NO_RGB_COMPONENTS 3
+
+  // floor(sum / 9) == (sum * BLUR_DIV9_MAGIC) >> 16 for every sum of nine bytes (0..2295)
+  #define BLUR_DIV9_MAGIC 7282
+
+  typedef void (*blur_row_fn)(unsigned char *, const unsigned char *, const unsigned char *,
+                              const unsigned char *, size_t, size_t);
+
+  // channel bytes [start, end) of the row, one at a time
+  static void blur_row_scalar(unsigned char *dst, const unsigned char *above,
+                              const unsigned char *row, const unsigned char *below,
+                              size_t start, size_t end){
+    for(size_t k = start; k < end; k++){
+      int sum = above[k - 3] + above[k] + above[k + 3]
+              + row[k - 3]   + row[k]   + row[k + 3]
+              + below[k - 3] + below[k] + below[k + 3];
+      dst[k] = sum / 9;
+    }
+  }
+
+#ifdef BLUR_KERNEL_X86
+
+  // 16 channel bytes per iteration, widened to 16-bit lanes
+  static void blur_row_sse2(unsigned char *dst, const unsigned char *above,
+                            const unsigned char *row, const unsigned char *below,
+                            size_t start, size_t end){
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i magic = _mm_set1_epi16(BLUR_DIV9_MAGIC);
+    const unsigned char *rows[3] = { above, row, below };
+    size_t k = start;
+
+    for(; k + 16 <= end; k += 16){
+      __m128i sum_lo = zero;
+      __m128i sum_hi = zero;
+      for(int r = 0; r < 3; r++){
+        for(int n = -3; n <= 3; n += 3){
+          __m128i v = _mm_loadu_si128((const __m128i *) (rows[r] + k + n));
+          sum_lo = _mm_add_epi16(sum_lo, _mm_unpacklo_epi8(v, zero));
+          sum_hi = _mm_add_epi16(sum_hi, _mm_unpackhi_epi8(v, zero));
+        }
+      }
+      sum_lo = _mm_mulhi_epu16(sum_lo, magic);
+      sum_hi = _mm_mulhi_epu16(sum_hi, magic);
+      _mm_storeu_si128((__m128i *) (dst + k), _mm_packus_epi16(sum_lo, sum_hi));
+    }
+
+    blur_row_scalar(dst, above, row, below, k, end);
+  }
+
+  // 32 channel bytes per iteration, widened to 16-bit lanes
+  __attribute__((target("avx2")))
+  static void blur_row_avx2(unsigned char *dst, const unsigned char *above,
+                            const unsigned char *row, const unsigned char *below,
+                            size_t start, size_t end){
+    const __m256i magic = _mm256_set1_epi16(BLUR_DIV9_MAGIC);
+    const unsigned char *rows[3] = { above, row, below };
+    size_t k = start;
+
+    for(; k + 32 <= end; k += 32){
+      __m256i sum_lo = _mm256_setzero_si256();
+      __m256i sum_hi = _mm256_setzero_si256();
+      for(int r = 0; r < 3; r++){
+        for(int n = -3; n <= 3; n += 3){
+          const unsigned char *p = rows[r] + k + n;
+          sum_lo = _mm256_add_epi16(sum_lo, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) p)));
+          sum_hi = _mm256_add_epi16(sum_hi, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *) (p + 16))));
+        }
+      }
+      sum_lo = _mm256_mulhi_epu16(sum_lo, magic);
+      sum_hi = _mm256_mulhi_epu16(sum_hi, magic);
+      // packus works per 128-bit lane, put the bytes back in order afterwards
+      __m256i packed = _mm256_packus_epi16(sum_lo, sum_hi);
+      packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+      _mm256_storeu_si256((__m256i *) (dst + k), packed);
+    }
+
+    blur_row_sse2(dst, above, row, below, k, end);
+  }
+
+#endif
+
+  static blur_row_fn blur_row_impl = blur_row_scalar;
+  static const char *blur_row_impl_name = "scalar";
+  static pthread_once_t blur_row_once = PTHREAD_ONCE_INIT;
+
+  // pick the widest kernel the running CPU supports
+  static void blur_kernel_select(void){
+#ifdef BLUR_KERNEL_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")){
+      blur_row_impl = blur_row_avx2;
+      blur_row_impl_name = "avx2";
+    } else if(__builtin_cpu_supports("sse2")){
+      blur_row_impl = blur_row_sse2;
+      blur_row_impl_name = "sse2";
+    }
+#endif
+  }
+
+  void blur_row_3x3(unsigned char *dst, const unsigned char *above, 
+                    const unsigned char *row, const unsigned char *below,
+                    int x_start, int x_end){
+    if(x_end <= x_start){
+      return;
+    }
+    pthread_once(&blur_row_once, blur_kernel_select);
+    blur_row_impl(dst, above, row, below,
+                  (size_t) x_start * NO_RGB_COMPONENTS, (size_t) x_end * NO_RGB_COMPONENTS);
+  }
+
+  const char *blur_kernel_name(void){
+    pthread_once(&blur_row_once, blur_kernel_select);
+    return blur_row_impl_name;
+  }
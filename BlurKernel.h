@@ -0,0 +1,15 @@
+#ifndef BLURKERNEL_H
+#define BLURKERNEL_H
+
+  // Blur the pixels [x_start, x_end) of one row of interleaved 8-bit RGB 
+  // pixels: every channel of dst is set to the integer mean of the 3x3 
+  // region around it, read from the rows above, row and below.
+  // NOTE: 1 <= x_start and x_end <= width - 1, dst must not alias the source rows
+  void blur_row_3x3(unsigned char *dst, const unsigned char *above, 
+                    const unsigned char *row, const unsigned char *below,
+                    int x_start, int x_end);
+
+  // name of the kernel implementation selected for this CPU
+  const char *blur_kernel_name(void);
+
+#endif
@@ -1,18 +1,30 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "Utils.h"
 #include "Picture.h"
 
   int main(int argc, char ** argv){
   
-    if(argc != 3){
-      printf("usage: ./picture_compare <file_path_1> <file_path_2>\n");
+    if(argc != 3 && argc != 4){
+      printf("usage: ./picture_compare <file_path_1> <file_path_2> [max_mean_diff]\n");
       return 1;
     }
   
     // capture and check command line arguments
     const char * pic1_filename = argv[1];
     const char * pic2_filename = argv[2];  
+    
+    // with a maximum mean difference, pictures only need to be close on average
+    // (e.g. two different JPEG encodings of the same picture)
+    double max_mean_diff = -1;
+    if(argc == 4){
+      max_mean_diff = atof(argv[3]);
+      if(max_mean_diff < 0){
+        printf("[!] invalid maximum mean difference %s\n", argv[3]);
+        return 1;
+      }
+    }
   
     printf("compare %s with %s:\n", pic1_filename, pic2_filename);
   
@@ -31,6 +43,26 @@
       return 1;
     }
   
+    if(max_mean_diff >= 0){
+      // sum the absolute RGB differences over the whole picture
+      double total_diff = 0;
+      for(int i = 0; i < width; i++){
+        for(int j = 0; j < height; j++){
+          struct pixel pixel1 = get_pixel(&pic1, i, j);
+          struct pixel pixel2 = get_pixel(&pic2, i, j);
+          total_diff += abs(pixel1.red - pixel2.red) + abs(pixel1.green - pixel2.green) + 
+                        abs(pixel1.blue - pixel2.blue);
+        }
+      }
+      double mean_diff = width * height > 0 ? total_diff / (3.0 * width * height) : 0;
+      if(mean_diff > max_mean_diff){
+        printf("[!] fail - mean difference %.3f exceeds %.3f\n", mean_diff, max_mean_diff);
+        return 1;
+      }
+      printf("success - pictures equivalent (mean difference %.3f)!\n", mean_diff);
+      return 0;
+    }
+  
     // iterate over the picture pixel-by-pixel and compare RGB values
     for(int i = 0; i < width; i++){
       for(int j = 0; j < height; j++){
@@ -0,0 +1,129 @@
+#include "PicPointOps.h"
+#include "PicProcess.h"
+
+  // bytes of picture rows handed to a thread at a time (kept within the L2 cache)
+  #define POINT_TILE_BYTES (128 * 1024)
+
+  #define LEVELS 256
+
+  // A compiled chain is a sequence of stages: either a table per channel, holding
+  // the composition of a run of per-channel operations, or a grayscale average.
+  struct point_stage {
+    bool grayscale;
+    unsigned char lut[PICTURE_CHANNELS][LEVELS];
+  };
+
+  struct point_task_args {
+    struct picture *pic;
+    const struct point_stage *stages;
+    int no_stages;
+  };
+
+  static int clamp_level(int v){
+    return v < 0 ? 0 : v > LEVELS - 1 ? LEVELS - 1 : v;
+  }
+
+  // value of one channel level after a per-channel operation
+  static unsigned char apply_point_op(const struct point_op *op, unsigned char v){
+    switch(op->type){
+      case(POINT_INVERT):
+        return MAX_PIXEL_INTENSITY - v;
+      case(POINT_BRIGHTNESS):
+        return clamp_level(v + op->amount);
+      case(POINT_CONTRAST):
+        return clamp_level((v - LEVELS / 2) * op->amount / 100 + LEVELS / 2);
+      case(POINT_LUT):
+        return op->lut[v];
+      default:
+        return v;
+    }
+  }
+
+  // turn the chain into as few stages as possible, returns the number of stages
+  static int compile_point_chain(const struct point_chain *chain, struct point_stage *stages){
+    int n = 0;
+    for(int k = 0; k < chain->length; k++){
+      const struct point_op *op = &chain->ops[k];
+      if(op->type == POINT_GRAYSCALE){
+        // the average of three equal channels is that channel
+        if(n == 0 || !stages[n - 1].grayscale){
+          stages[n++].grayscale = true;
+        }
+        continue;
+      }
+
+      // start a new table stage, or fold the operation into the previous one
+      if(n == 0 || stages[n - 1].grayscale){
+        stages[n].grayscale = false;
+        for(int c = 0; c < PICTURE_CHANNELS; c++){
+          for(int v = 0; v < LEVELS; v++){
+            stages[n].lut[c][v] = v;
+          }
+        }
+        n++;
+      }
+      for(int c = 0; c < PICTURE_CHANNELS; c++){
+        for(int v = 0; v < LEVELS; v++){
+          stages[n - 1].lut[c][v] = apply_point_op(op, stages[n - 1].lut[c][v]);
+        }
+      }
+    }
+    return n;
+  }
+
+  // run every stage over each pixel of the rows [start, end)
+  static void point_rows_task(int start, int end, void *args_ptr){
+    struct point_task_args *args = (struct point_task_args *) args_ptr;
+    size_t pixels = (size_t) (end - start) * args->pic->width;
+    unsigned char *p = picture_row(args->pic, start);
+
+    for(size_t i = 0; i < pixels; i++, p += PICTURE_CHANNELS){
+      int red = p[0];
+      int green = p[1];
+      int blue = p[2];
+      for(int s = 0; s < args->no_stages; s++){
+        const struct point_stage *stage = &args->stages[s];
+        if(stage->grayscale){
+          red = green = blue = (red + green + blue) / PICTURE_CHANNELS;
+        } else {
+          red = stage->lut[0][red];
+          green = stage->lut[1][green];
+          blue = stage->lut[2][blue];
+        }
+      }
+      p[0] = red;
+      p[1] = green;
+      p[2] = blue;
+    }
+  }
+
+  void init_point_chain(struct point_chain *chain){
+    chain->length = 0;
+  }
+
+  bool add_point_op(struct point_chain *chain, enum point_op_type type, int amount,
+                    const unsigned char *lut){
+    if(chain->length == MAX_POINT_OPS || (type == POINT_LUT && lut == NULL)){
+      return false;
+    }
+    struct point_op op = { type, amount, lut };
+    chain->ops[chain->length++] = op;
+    return true;
+  }
+
+  void apply_point_chain(struct picture *pic, const struct point_chain *chain){
+    struct point_stage stages[MAX_POINT_OPS];
+    int no_stages = compile_point_chain(chain, stages);
+    if(no_stages == 0 || pic->width == 0){
+      return;
+    }
+
+    // rows per task: as many as fit in a tile, at least one
+    int grain = POINT_TILE_BYTES / (pic->width * PICTURE_CHANNELS);
+    if(grain < 1){
+      grain = 1;
+    }
+
+    struct point_task_args args = { pic, stages, no_stages };
+    thpool_parallel_for(get_picture_threadpool(), 0, pic->height, grain, point_rows_task, &args);
+  }
@@ -0,0 +1,49 @@
+#ifndef PICPOINTOPS_H
+#define PICPOINTOPS_H
+
+#include "Picture.h"
+#include "Utils.h"
+#include <stdbool.h>
+
+  // longest chain of point operations applied in one pass
+  #define MAX_POINT_OPS 16
+
+  // picture transformations where every output pixel only depends on the same
+  // input pixel, so any run of them can be applied in a single pass
+  enum point_op_type {
+    POINT_INVERT,
+    POINT_GRAYSCALE,
+    // add amount to every channel (clamped to 0..255)
+    POINT_BRIGHTNESS,
+    // scale the distance of every channel from mid-gray by amount percent (clamped)
+    POINT_CONTRAST,
+    // replace every channel value v by lut[v]
+    POINT_LUT
+  };
+
+  struct point_op {
+    enum point_op_type type;
+    int amount;
+    const unsigned char *lut;
+  };
+
+  // operations to apply, in order
+  struct point_chain {
+    struct point_op ops[MAX_POINT_OPS];
+    int length;
+  };
+
+  // start an empty chain (applying it leaves the picture unchanged)
+  void init_point_chain(struct point_chain *chain);
+
+  // append an operation to the chain, false when the chain is full
+  bool add_point_op(struct point_chain *chain, enum point_op_type type, int amount,
+                    const unsigned char *lut);
+
+  // Applies the whole chain to pic in one pass over its pixels: consecutive
+  // per-channel operations are merged into a table per channel beforehand and the
+  // picture is swept a cache-sized band of rows at a time on the picture thread
+  // pool. The result is the same as applying the operations one after the other.
+  void apply_point_chain(struct picture *pic, const struct point_chain *chain);
+
+#endif
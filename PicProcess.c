@@ -1,58 +1,34 @@
 #include "PicProcess.h"
-#include "Thpool.h"
+#include "BlurKernel.h"
+#include "PicPointOps.h"
+#include <string.h>
 
-  #define NO_RGB_COMPONENTS 3
-  #define BLUR_REGION_SIZE 9
-  #define MAX_RUNNING_THREAD_SIZE 100
+  // rows of the picture copied and blurred together by one parallel blur task
+  #define BLUR_BAND_ROWS 32
 
-  struct pixel_blurring_task_args {
-    struct picture *pic;
-    struct picture tmp;
-    int i;
-    int j;
-  };
+  // thread pool set with set_picture_threadpool, NULL for the process-wide pool
+  static threadpool picture_thpool = NULL;
+
+  // invert and grayscale are point operations, applied by a one-operation chain
+  static void apply_point_op_to_picture(struct picture *pic, enum point_op_type type){
+    struct point_chain chain;
+    init_point_chain(&chain);
+    add_point_op(&chain, type, 0, NULL);
+    apply_point_chain(pic, &chain);
+  }
 
   void invert_picture(struct picture *pic) {
-    // iterate over each pixel in the picture
-    for(int i = 0 ; i < pic->width; i++){
-      for(int j = 0 ; j < pic->height; j++){
-        struct pixel rgb = get_pixel(pic, i, j);
-        
-        // invert RGB values of pixel
-        rgb.red = MAX_PIXEL_INTENSITY - rgb.red;
-        rgb.green = MAX_PIXEL_INTENSITY - rgb.green;
-        rgb.blue = MAX_PIXEL_INTENSITY - rgb.blue;
-        
-        // set pixel to inverted RBG values
-        set_pixel(pic, i, j, &rgb);
-      }
-    }   
+    apply_point_op_to_picture(pic, POINT_INVERT);
   }
 
   void grayscale_picture(struct picture *pic){
-    // iterate over each pixel in the picture
-    for(int i = 0 ; i < pic->width; i++){
-      for(int j = 0 ; j < pic->height; j++){
-        struct pixel rgb = get_pixel(pic, i, j);
-        
-        // compute gray average of pixel's RGB values
-        int avg = (rgb.red + rgb.green + rgb.blue) / NO_RGB_COMPONENTS;
-        rgb.red = avg;
-        rgb.green = avg;
-        rgb.blue = avg;
-        
-        // set pixel to gray-scale RBG value
-        set_pixel(pic, i, j, &rgb);
-      }
-    }    
+    apply_point_op_to_picture(pic, POINT_GRAYSCALE);
   }
 
   void rotate_picture(struct picture *pic, int angle){
     // make temporary copy of picture to work from
     struct picture tmp;
-    tmp.img = copy_image(pic->img);
-    tmp.width = pic->width;
-    tmp.height = pic->height; 
+    copy_picture(&tmp, pic);
   
     int new_width = tmp.width;
     int new_height = tmp.height;
@@ -96,9 +72,7 @@
   void flip_picture(struct picture *pic, char plane) {
     // make temporary copy of picture to work from
     struct picture tmp;
-    tmp.img = copy_image(pic->img);
-    tmp.width = pic->width;
-    tmp.height = pic->height;  
+    copy_picture(&tmp, pic);
     
     // iterate over each pixel in the picture
     for(int i = 0 ; i < tmp.width; i++){
@@ -125,108 +99,218 @@
     clear_picture(&tmp);
   }
 
+  // blur the non-boundary pixels of row j of pic from the 3x3 regions in tmp
+  static void blur_row(struct picture *pic, struct picture *tmp, int j) {
+    blur_row_3x3(picture_row(pic, j), picture_row(tmp, j - 1), picture_row(tmp, j),
+                 picture_row(tmp, j + 1), 1, tmp->width - 1);
+  }
+
   void blur_picture(struct picture *pic) {
     // make temporary copy of picture to work from
     struct picture tmp;
-    tmp.img = copy_image(pic->img);
-    tmp.width = pic->width;
-    tmp.height = pic->height;  
+    copy_picture(&tmp, pic);
   
-    // iterate over each pixel in the picture (ignoring boundary pixels)
-    for(int i = 1 ; i < tmp.width - 1; i++){
-      for(int j = 1 ; j < tmp.height - 1; j++){
-
-        // set-up a local pixel on the stack
-        struct pixel rgb;  
-        int sum_red = 0;
-        int sum_green = 0;
-        int sum_blue = 0;
-      
-        // check the surrounding pixel region
-        for(int n = -1; n <= 1; n++){
-          for(int m = -1; m <= 1; m++){
-            rgb = get_pixel(&tmp, i+n, j+m);
-            sum_red += rgb.red;
-            sum_green += rgb.green;
-            sum_blue += rgb.blue;
-          }
-        }
-      
-        // compute average pixel RGB value
-        rgb.red = sum_red / BLUR_REGION_SIZE;
-        rgb.green = sum_green / BLUR_REGION_SIZE;
-        rgb.blue = sum_blue / BLUR_REGION_SIZE;
-      
-        // set pixel to region average RBG value
-        set_pixel(pic, i, j, &rgb);
-      }
+    // iterate over each row in the picture (ignoring boundary pixels)
+    for(int j = 1 ; j < tmp.height - 1; j++){
+      blur_row(pic, &tmp, j);
     }
     
     // temporary picture clean-up
     clear_picture(&tmp);
   }
-  
-  void parallel_blur_picture(struct picture *pic) {
-    // make temporary copy of picture to work from
+
+  struct blurring_task_args {
+    struct picture *pic;
+    // first and last row of every band, as they were before any band was blurred
+    unsigned char *edges;
+  };
+
+  // unblurred copy of row j, a row next to a task's bands (which the task running
+  // the neighbouring band may already have overwritten)
+  static const unsigned char *band_source_row(struct blurring_task_args *args, int j) {
+    int band = (j - 1) / BLUR_BAND_ROWS;
+    size_t row_len = (size_t) args->pic->width * PICTURE_CHANNELS;
+    if(j == 0 || j == args->pic->height - 1){
+      return picture_row(args->pic, j);
+    }
+    if(j == 1 + band * BLUR_BAND_ROWS){
+      return args->edges + (size_t) 2 * band * row_len;
+    }
+    return args->edges + (size_t) (2 * band + 1) * row_len;
+  }
+
+  // copy the bands [start, end) with the rows around them into a buffer of the
+  // task's own (first touched on the node of the worker running it) and blur from it
+  static void blur_bands_task(int start, int end, void *args_ptr) {
+    struct blurring_task_args *args = (struct blurring_task_args *) args_ptr;
+    struct picture *pic = args->pic;
+    size_t row_len = (size_t) pic->width * PICTURE_CHANNELS;
+    int first = 1 + start * BLUR_BAND_ROWS;
+    int last = 1 + end * BLUR_BAND_ROWS;
+    if(last > pic->height - 1){
+      last = pic->height - 1;
+    }
+
     struct picture tmp;
-    tmp.img = copy_image(pic->img);
-    tmp.width = pic->width;
-    tmp.height = pic->height;   
+    if(!init_picture_from_size(&tmp, pic->width, last - first + 2)){
+      printf("[!] parallel blur could not allocate its working memory\n");
+      exit(IO_ERROR);
+    }
+    memcpy(picture_row(&tmp, 0), band_source_row(args, first - 1), row_len);
+    memcpy(picture_row(&tmp, 1), picture_row(pic, first), (size_t) (last - first) * row_len);
+    memcpy(picture_row(&tmp, last - first + 1), band_source_row(args, last), row_len);
+    for(int j = first; j < last; j++){
+      blur_row_3x3(picture_row(pic, j), picture_row(&tmp, j - first), picture_row(&tmp, j - first + 1),
+                   picture_row(&tmp, j - first + 2), 1, pic->width - 1);
+    }
+    clear_picture(&tmp);
+  }
 
-    threadpool thpool = thpool_init(MAX_RUNNING_THREAD_SIZE);
-    
-    // iterate over each pixel in the picture (ignoring boundary pixels)
-    for(int i = 1 ; i < tmp.width - 1; i++){
-      for(int j = 1 ; j < tmp.height - 1; j++){
-        struct pixel_blurring_task_args *params = (struct pixel_blurring_task_args*) malloc(sizeof(struct pixel_blurring_task_args)); 
-        params->pic = pic;
-        params->tmp = tmp;
-        params->i = i;
-        params->j = j;
-
-        thpool_add_work(thpool, (void *) pixel_blurring_task, (void *) params);
+  void parallel_blur_picture(struct picture *pic) {
+    int rows = pic->height - 2;
+    if(rows <= 0){
+      return;
+    }
+    int no_bands = (rows + BLUR_BAND_ROWS - 1) / BLUR_BAND_ROWS;
+    size_t row_len = (size_t) pic->width * PICTURE_CHANNELS;
+
+    // snapshot the first and last row of every band, which its neighbours read
+    unsigned char *edges = malloc((size_t) 2 * no_bands * row_len);
+    if(edges == NULL){
+      printf("[!] parallel blur could not allocate its working memory\n");
+      exit(IO_ERROR);
+    }
+    for(int band = 0; band < no_bands; band++){
+      int band_first = 1 + band * BLUR_BAND_ROWS;
+      int band_last = band_first + BLUR_BAND_ROWS - 1;
+      if(band_last > pic->height - 2){
+        band_last = pic->height - 2;
       }
+      memcpy(edges + (size_t) 2 * band * row_len, picture_row(pic, band_first), row_len);
+      memcpy(edges + (size_t) (2 * band + 1) * row_len, picture_row(pic, band_last), row_len);
     }
-        
-    thpool_wait(thpool);
-    thpool_destroy(thpool);  
 
-    // temporary picture clean-up
-    clear_picture(&tmp);
+    // each task copies and blurs its bands itself, so the copy is local to the blur
+    struct blurring_task_args args = { pic, edges };
+    thpool_parallel_for(get_picture_threadpool(), 0, no_bands, 1, blur_bands_task, &args);
+
+    free(edges);
   }
 
-  void pixel_blurring_task(void *args_ptr) {
-    struct pixel_blurring_task_args *args = (struct pixel_blurring_task_args *) args_ptr;
-    struct picture *pic = (struct picture *) args->pic;
-    struct picture tmp = (struct picture) args->tmp;
-    int i = (int) args->i;
-    int j = (int) args->j;
-
-    // set-up a local pixel on the stack
-    struct pixel rgb;  
-    int sum_red = 0;
-    int sum_green = 0;
-    int sum_blue = 0;
-
-    // check the surrounding pixel region
-    for(int n = -1; n <= 1; n++){
-      for(int m = -1; m <= 1; m++){
-        rgb = get_pixel(&tmp, i+n, j+m);
-        sum_red += rgb.red;
-        sum_green += rgb.green;
-        sum_blue += rgb.blue;
+  struct box_blurring_task_args {
+    struct picture *pic;
+    int *row_sums;
+    int radius;
+  };
+
+  // horizontal pass: running sum of the 2*radius+1 pixels around each
+  // non-boundary pixel of the rows [start, end)
+  static void box_blur_rows_task(int start, int end, void *args_ptr) {
+    struct box_blurring_task_args *args = (struct box_blurring_task_args *) args_ptr;
+    int r = args->radius;
+    int width = args->pic->width;
+
+    for(int j = start; j < end; j++){
+      const unsigned char *row = picture_row(args->pic, j);
+      int *sums = args->row_sums + (size_t) j * width * PICTURE_CHANNELS;
+
+      for(int c = 0; c < PICTURE_CHANNELS; c++){
+        // prime the window centred on x = r
+        int sum = 0;
+        for(int x = 0; x <= 2 * r; x++){
+          sum += row[x * PICTURE_CHANNELS + c];
+        }
+        sums[r * PICTURE_CHANNELS + c] = sum;
+
+        // slide it one pixel at a time
+        for(int x = r + 1; x < width - r; x++){
+          sum += row[(x + r) * PICTURE_CHANNELS + c] - row[(x - r - 1) * PICTURE_CHANNELS + c];
+          sums[x * PICTURE_CHANNELS + c] = sum;
+        }
       }
     }
+  }
 
-    // compute average pixel RGB value
-    rgb.red = sum_red / BLUR_REGION_SIZE;
-    rgb.green = sum_green / BLUR_REGION_SIZE;
-    rgb.blue = sum_blue / BLUR_REGION_SIZE;
+  // vertical pass: running sum of the 2*radius+1 row sums around each
+  // non-boundary row in [start, end), written back as the region average
+  static void box_blur_cols_task(int start, int end, void *args_ptr) {
+    struct box_blurring_task_args *args = (struct box_blurring_task_args *) args_ptr;
+    int r = args->radius;
+    int area = (2 * r + 1) * (2 * r + 1);
+    size_t row_len = (size_t) args->pic->width * PICTURE_CHANNELS;
+    size_t first = (size_t) r * PICTURE_CHANNELS;
+    size_t last = row_len - first;
 
-    // set pixel to region average RBG value
-    set_pixel(pic, i, j, &rgb);
+    long *acc = malloc(row_len * sizeof(long));
+    if(acc == NULL){
+      // the band would keep the row sums of the horizontal pass
+      printf("[!] box blur could not allocate its working memory\n");
+      exit(IO_ERROR);
+    }
 
-    free(args);
+    // prime the window centred on the first row of the band
+    for(size_t k = first; k < last; k++){
+      acc[k] = 0;
+    }
+    for(int y = start - r; y <= start + r; y++){
+      const int *sums = args->row_sums + y * row_len;
+      for(size_t k = first; k < last; k++){
+        acc[k] += sums[k];
+      }
+    }
+
+    for(int j = start; j < end; j++){
+      unsigned char *row = picture_row(args->pic, j);
+      for(size_t k = first; k < last; k++){
+        row[k] = acc[k] / area;
+      }
+
+      // slide the window down one row
+      if(j + 1 < end){
+        const int *enter = args->row_sums + (j + r + 1) * row_len;
+        const int *leave = args->row_sums + (j - r) * row_len;
+        for(size_t k = first; k < last; k++){
+          acc[k] += enter[k] - leave[k];
+        }
+      }
+    }
+
+    free(acc);
   }
 
-  
+  void box_blur_picture(struct picture *pic, int radius) {
+    if(radius < 1){
+      printf("[!] box blur is undefined for radius %i (must be at least 1)\n", radius);
+      exit(IO_ERROR);
+    }
+
+    // nothing but boundary pixels
+    if(pic->width <= 2 * radius || pic->height <= 2 * radius){
+      return;
+    }
+
+    struct box_blurring_task_args args;
+    args.pic = pic;
+    args.radius = radius;
+    args.row_sums = malloc((size_t) pic->width * pic->height * PICTURE_CHANNELS * sizeof(int));
+    if(args.row_sums == NULL){
+      printf("[!] box blur could not allocate its working memory\n");
+      exit(IO_ERROR);
+    }
+
+    // the horizontal pass only reads the picture, so the vertical pass can 
+    // write its results in place
+    threadpool thpool = get_picture_threadpool();
+    thpool_parallel_for(thpool, 0, pic->height, 16, box_blur_rows_task, &args);
+    thpool_parallel_for(thpool, radius, pic->height - radius, 64, box_blur_cols_task, &args);
+
+    free(args.row_sums);
+  }
+
+  threadpool get_picture_threadpool(void) {
+    return picture_thpool != NULL ? picture_thpool : thpool_global();
+  }
+
+  void set_picture_threadpool(threadpool thpool) {
+    picture_thpool = thpool;
+  }
@@ -3,6 +3,7 @@
 
 #include "Picture.h"
 #include "Utils.h"
+#include "Thpool.h"
 #include <stdio.h>
 #include <pthread.h>
   
@@ -13,7 +14,12 @@
   void flip_picture(struct picture *pic, char plane);
   void blur_picture(struct picture *pic);
   void parallel_blur_picture(struct picture *pic);
-  void pixel_blurring_task(void *args_ptr);
+  void box_blur_picture(struct picture *pic, int radius);
+
+  // thread pool used by the parallel transformations (the process-wide pool
+  // unless another one was set, setting NULL restores the process-wide pool)
+  threadpool get_picture_threadpool(void);
+  void set_picture_threadpool(threadpool thpool);
 
 #endif
 
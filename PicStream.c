@@ -0,0 +1,140 @@
+#include "PicStream.h"
+#include "BlurKernel.h"
+#include <string.h>
+
+  // state carried from one decoded band to the next
+  struct stream_state {
+    enum stream_op op;
+    const char *dst;
+    const struct jpeg_options *options;
+    // opened with the first band, once the picture size is known
+    sod_jpeg_stream *out;
+    // blur only: ring of the last two rows seen (row y in slot y % 2), the rows
+    // above the next band, and the blurred rows of the current band
+    unsigned char *halo;
+    unsigned char *blurred;
+    int blurred_rows;
+  };
+
+  static void invert_rows(unsigned char *rows, size_t bytes){
+    for(size_t k = 0; k < bytes; k++){
+      rows[k] = MAX_PIXEL_INTENSITY - rows[k];
+    }
+  }
+
+  static void grayscale_rows(unsigned char *rows, size_t pixels){
+    for(size_t i = 0; i < pixels; i++, rows += PICTURE_CHANNELS){
+      unsigned char avg = (rows[0] + rows[1] + rows[2]) / PICTURE_CHANNELS;
+      rows[0] = avg;
+      rows[1] = avg;
+      rows[2] = avg;
+    }
+  }
+
+  static void flip_rows(unsigned char *rows, int n_rows, int width){
+    for(int j = 0; j < n_rows; j++, rows += (size_t) width * PICTURE_CHANNELS){
+      for(int i = 0; i < width / 2; i++){
+        unsigned char *left = rows + i * PICTURE_CHANNELS;
+        unsigned char *right = rows + (width - 1 - i) * PICTURE_CHANNELS;
+        for(int c = 0; c < PICTURE_CHANNELS; c++){
+          unsigned char tmp = left[c];
+          left[c] = right[c];
+          right[c] = tmp;
+        }
+      }
+    }
+  }
+
+  // row r of the picture, from the band starting at row y or (just above it) the halo
+  static unsigned char *band_row(struct stream_state *st, unsigned char *rows, int y,
+                                 int r, size_t stride){
+    return r >= y ? rows + (size_t) (r - y) * stride : st->halo + (r % 2) * stride;
+  }
+
+  // Blur the band of rows [y, y + n_rows) into st->blurred. Every row needs the one
+  // below it, so the band's output lags its input by a row (the halo holds the two
+  // rows above the band), and the boundary rows and columns are copied unchanged.
+  static bool blur_band(struct stream_state *st, unsigned char *rows, int y, int n_rows,
+                        int width, int height){
+    size_t stride = (size_t) width * PICTURE_CHANNELS;
+    int out = 0;
+
+    if(st->blurred_rows < n_rows + 1){
+      unsigned char *blurred = realloc(st->blurred, (n_rows + 1) * stride);
+      if(blurred == NULL){
+        return false;
+      }
+      st->blurred = blurred;
+      st->blurred_rows = n_rows + 1;
+    }
+
+    for(int r = y; r < y + n_rows; r++){
+      if(r == 0){
+        continue;
+      }
+      unsigned char *dst = st->blurred + out++ * stride;
+      memcpy(dst, band_row(st, rows, y, r - 1, stride), stride);
+      if(r - 1 > 0){
+        blur_row_3x3(dst, band_row(st, rows, y, r - 2, stride), band_row(st, rows, y, r - 1, stride),
+                     band_row(st, rows, y, r, stride), 1, width - 1);
+      }
+    }
+    if(y + n_rows == height){
+      memcpy(st->blurred + out++ * stride, band_row(st, rows, y, height - 1, stride), stride);
+    }
+
+    // keep the band's last two rows for the next one
+    for(int r = y + n_rows - 2; r < y + n_rows; r++){
+      if(r >= y){
+        memcpy(st->halo + (r % 2) * stride, band_row(st, rows, y, r, stride), stride);
+      }
+    }
+    return write_pixel_rows(st->out, st->blurred, out);
+  }
+
+  static bool stream_band(void *user, unsigned char *rows, int y, int n_rows, int width, int height){
+    struct stream_state *st = (struct stream_state *) user;
+
+    if(st->out == NULL){
+      if(st->op == STREAM_BLUR){
+        st->halo = malloc(2 * (size_t) width * PICTURE_CHANNELS);
+        if(st->halo == NULL){
+          return false;
+        }
+      }
+      st->out = begin_pixel_stream(st->dst, width, height, st->options);
+      if(st->out == NULL){
+        return false;
+      }
+    }
+
+    switch(st->op){
+      case(STREAM_INVERT):
+        invert_rows(rows, (size_t) n_rows * width * PICTURE_CHANNELS);
+        break;
+      case(STREAM_GRAYSCALE):
+        grayscale_rows(rows, (size_t) n_rows * width);
+        break;
+      case(STREAM_FLIP_H):
+        flip_rows(rows, n_rows, width);
+        break;
+      case(STREAM_BLUR):
+        return blur_band(st, rows, y, n_rows, width, height);
+    }
+    return write_pixel_rows(st->out, rows, n_rows);
+  }
+
+  bool stream_picture(const char *src, const char *dst, enum stream_op op,
+                      const struct jpeg_options *options){
+    struct stream_state st = { op, dst, options, NULL, NULL, NULL, 0 };
+
+    bool loaded = load_pixel_bands(src, stream_band, &st);
+    bool saved = false;
+    if(st.out != NULL){
+      // also releases the stream when loading failed part way
+      saved = end_pixel_stream(st.out, dst);
+    }
+    free(st.halo);
+    free(st.blurred);
+    return loaded && saved;
+  }
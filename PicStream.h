@@ -0,0 +1,25 @@
+#ifndef PICSTREAM_H
+#define PICSTREAM_H
+
+#include "Picture.h"
+#include "Utils.h"
+#include <stdbool.h>
+
+  // picture transformations that only look at a few neighbouring rows, so they
+  // can be applied to a band of rows at a time
+  enum stream_op {
+    STREAM_INVERT,
+    STREAM_GRAYSCALE,
+    STREAM_BLUR,
+    STREAM_FLIP_H
+  };
+
+  // Applies op to the picture file at src and saves the result to dst, decoding,
+  // transforming and encoding one band of rows at a time: memory use grows with the
+  // width of the picture, not its height. The result is the same as applying the
+  // PicProcess transformation to the whole picture and saving it without
+  // parallel_encode (NULL options selects default_jpeg_options).
+  bool stream_picture(const char *src, const char *dst, enum stream_op op,
+                      const struct jpeg_options *options);
+
+#endif
@@ -1,20 +1,45 @@
 #include "Picture.h"
+#include <string.h>
 
   bool init_picture_from_file(struct picture *pic, const char *path){
-    pic->img = load_image(path);
+    // the decoder's interleaved bytes become the picture storage as they are
+    pic->data = load_pixels(path, &pic->width, &pic->height);
     // check for picture initialisation error
-    if( pic->img.data == 0 ){
+    if( pic->data == NULL ){
       return false;
     }    
-    pic->width = get_image_width(pic->img);
-    pic->height = get_image_height(pic->img);
+    return true;
+  }
+
+  bool init_picture_from_file_scaled(struct picture *pic, const char *path, int denom){
+    if(denom == 1){
+      return init_picture_from_file(pic, path);
+    }
+    sod_img img = load_image_scaled(path, denom);
+    // check for picture initialisation error
+    if( img.data == 0 ){
+      return false;
+    }
+    bool ok = init_picture_from_image(pic, img);
+    free_image(img);
+    return ok;
+  }
+
+  bool init_picture_from_image(struct picture *pic, sod_img img){
+    pic->data = image_to_pixels(img);
+    // check for picture initialisation error
+    if( pic->data == NULL ){
+      return false;
+    }
+    pic->width = get_image_width(img);
+    pic->height = get_image_height(img);
     return true;
   }
 
   bool init_picture_from_size(struct picture *pic, int width, int height){
-    pic->img = create_image(width, height);
+    pic->data = calloc((size_t) width * height, PICTURE_CHANNELS);
     // check for picture initialisation error
-    if ( pic->img.data == 0 ){
+    if ( pic->data == NULL ){
       return false;
     }
     pic->width = width;
@@ -22,29 +47,16 @@
     return true;
   }
 
-  bool save_picture_to_file(struct picture *pic, const char *path){
-    return save_image(pic->img, path);   
-  }
-
-  // enum mapping to support get/set pixel functions
-  enum RGB {RED, GREEN, BLUE};
-
-  struct pixel get_pixel(struct picture *pic, int x, int y){
-    // Beware: pixels are stored in a (x,y) vector from the top left of the image.
-    struct pixel pix;
-    
-    pix.red = get_pixel_value(pic->img, RED, x, y);
-    pix.green = get_pixel_value(pic->img, GREEN, x, y);
-    pix.blue = get_pixel_value(pic->img, BLUE, x, y);
-    
-    return pix;
+  bool copy_picture(struct picture *dst, struct picture *src){
+    if(!init_picture_from_size(dst, src->width, src->height)){
+      return false;
+    }
+    memcpy(dst->data, src->data, (size_t) src->width * src->height * PICTURE_CHANNELS);
+    return true;
   }
 
-  void set_pixel(struct picture *pic, int x, int y, struct pixel *rgb){
-    // Beware: pixels are stored in a (x,y) vector from the top left of the image.
-    set_pixel_value(pic->img, RED, x, y, rgb->red);
-    set_pixel_value(pic->img, GREEN, x, y, rgb->green);
-    set_pixel_value(pic->img, BLUE, x, y, rgb->blue);
+  bool save_picture_to_file(struct picture *pic, const char *path, const struct jpeg_options *options){
+    return save_pixels(pic->data, pic->width, pic->height, path, options);   
   }
 
   bool contains_point(struct picture *pic, int x, int y){
@@ -52,5 +64,6 @@
   }
   
   void clear_picture(struct picture *pic){
-    free_image(pic->img); 
+    free(pic->data); 
+    pic->data = NULL;
   }  
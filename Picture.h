@@ -3,6 +3,10 @@
 
 #include "Utils.h"
 #include <stdbool.h>
+#include <stddef.h>
+
+  // number of interleaved colour channels stored per pixel
+  #define PICTURE_CHANNELS 3
 
   // The pixel struct is used to represent a pixel of an image in RGB format
   struct pixel {
@@ -14,8 +18,9 @@
   // The picture struct provides a wrapper for image manipulation 
   // via the SOD library (https://sod.pixlab.io/intro.html)
   struct picture {    
-    // sod representation of an image
-    sod_img img;
+    // interleaved 8-bit RGB pixels, stored row by row from the top left
+    // (the sod representation is only used while loading and saving)
+    unsigned char *data;
     int width;
     int height;
   };    
@@ -23,17 +28,22 @@
   // initialise picture struct with image from a provided file
   bool init_picture_from_file(struct picture *pic, const char *path);
 
+  // initialise picture struct with image from a provided file, decoded at
+  // 1/denom (1, 2, 4 or 8) of its size
+  bool init_picture_from_file_scaled(struct picture *pic, const char *path, int denom);
+
+  // initialise picture struct with a copy of the pixels of a sod image
+  bool init_picture_from_image(struct picture *pic, sod_img img);
+
   // initialise picture struct of the specified size 
   bool init_picture_from_size(struct picture *pic, int width, int height); 
 
-  // save picture to specified file
-  bool save_picture_to_file(struct picture *pic, const char *path);
+  // initialise picture struct as a copy of another picture
+  bool copy_picture(struct picture *dst, struct picture *src);
 
-  // extract a single pixel from the image as a colour struct
-  struct pixel get_pixel(struct picture *pic, int x, int y);
-
-  // set a single pixel in the image from a colour struct
-  void set_pixel(struct picture *pic, int x, int y, struct pixel *rgb);
+  // save picture to specified file with the given JPEG encoder settings 
+  // (NULL selects default_jpeg_options)
+  bool save_picture_to_file(struct picture *pic, const char *path, const struct jpeg_options *options);
 
   // check if coordinates are within bounds of the stored image
   bool contains_point(struct picture *pic, int x, int y);
@@ -41,4 +51,28 @@
   // clean up the underlying image representation
   void clear_picture(struct picture *pic);
 
+  // first byte of row y of the picture (no bounds checking)
+  static inline unsigned char *picture_row(struct picture *pic, int y){
+    return pic->data + (size_t) y * pic->width * PICTURE_CHANNELS;
+  }
+
+  // extract a single pixel from the image as a colour struct
+  // NOTE: (x,y) must be within bounds, see contains_point
+  static inline struct pixel get_pixel(struct picture *pic, int x, int y){
+    // Beware: pixels are stored in a (x,y) vector from the top left of the image.
+    const unsigned char *p = picture_row(pic, y) + x * PICTURE_CHANNELS;
+    struct pixel pix = { p[0], p[1], p[2] };
+    return pix;
+  }
+
+  // set a single pixel in the image from a colour struct
+  // NOTE: (x,y) must be within bounds, see contains_point
+  static inline void set_pixel(struct picture *pic, int x, int y, struct pixel *rgb){
+    // Beware: pixels are stored in a (x,y) vector from the top left of the image.
+    unsigned char *p = picture_row(pic, y) + x * PICTURE_CHANNELS;
+    p[0] = rgb->red;
+    p[1] = rgb->green;
+    p[2] = rgb->blue;
+  }
+
 #endif
@@ -1,9 +1,15 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
 #include "Utils.h"
 #include "Picture.h"
 #include "PicProcess.h"
+#include "PicStream.h"
+#include "PicPointOps.h"
+#include "Thpool.h"
 
   // list of all possible picture transformations
   static char *cmd_strings[] = { 
@@ -12,7 +18,10 @@
     "rotate",
     "flip",
     "blur",
-    "parallel-blur"
+    "parallel-blur",
+    "box-blur",
+    "brightness",
+    "contrast"
   };
 
 // -------------- picture transformation function wrappers -------------- \\
@@ -49,6 +58,30 @@
     parallel_blur_picture(pic);
   }
 
+  void box_blur_wrapper(struct picture *pic, const char *extra_arg){
+    int radius = extra_arg ? atoi(extra_arg) : 1;
+    printf("calling box blur (%i)\n", radius);
+    box_blur_picture(pic, radius);
+  }
+
+  void brightness_wrapper(struct picture *pic, const char *extra_arg){
+    int amount = extra_arg ? atoi(extra_arg) : 0;
+    printf("calling brightness (%i)\n", amount);
+    struct point_chain chain;
+    init_point_chain(&chain);
+    add_point_op(&chain, POINT_BRIGHTNESS, amount, NULL);
+    apply_point_chain(pic, &chain);
+  }
+
+  void contrast_wrapper(struct picture *pic, const char *extra_arg){
+    int amount = extra_arg ? atoi(extra_arg) : 100;
+    printf("calling contrast (%i)\n", amount);
+    struct point_chain chain;
+    init_point_chain(&chain);
+    add_point_op(&chain, POINT_CONTRAST, amount, NULL);
+    apply_point_chain(pic, &chain);
+  }
+
 // ------------------------------------------------------------------------ \\
 
   // function pointer look-up table for picture transformation functions
@@ -58,12 +91,176 @@
     rotate_picture_wrapper,
     flip_picture_wrapper,
     blur_picture_wrapper,
-    parallel_blur_wrapper
+    parallel_blur_wrapper,
+    box_blur_wrapper,
+    brightness_wrapper,
+    contrast_wrapper
   };
 
   // size of look-up table (for safe IO error reporting)
   static int no_of_cmds = sizeof(cmds) / sizeof(cmds[0]);
 
+// ------------ lossless (JPEG to JPEG) transformation wrappers ------------ \\
+
+  bool lossless_rotate_wrapper(const char *filename, const char *target_file, const char *extra_arg){
+    int angle = extra_arg ? atoi(extra_arg) : 0;
+    if(angle != 90 && angle != 180 && angle != 270){
+      return false;
+    }
+    printf("calling lossless rotate (%i)\n", angle);
+    return transform_jpeg(filename, target_file, 
+                          angle == 90 ? JPEG_ROTATE_90 : angle == 180 ? JPEG_ROTATE_180 : JPEG_ROTATE_270);
+  }
+
+  bool lossless_flip_wrapper(const char *filename, const char *target_file, const char *extra_arg){
+    char plane = extra_arg ? extra_arg[0] : '\0';
+    if(plane != 'H' && plane != 'V'){
+      return false;
+    }
+    printf("calling lossless flip (%c)\n", plane);
+    return transform_jpeg(filename, target_file, plane == 'H' ? JPEG_FLIP_H : JPEG_FLIP_V);
+  }
+
+  // lossless counterparts of the look-up table entries (NULL where there is none)
+  static bool (* const lossless_cmds[])(const char *, const char *, const char *) = { 
+    NULL,
+    NULL,
+    lossless_rotate_wrapper,
+    lossless_flip_wrapper,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+  };
+
+// ------------ streamed (band at a time) transformation wrappers ------------ \\
+
+  bool stream_invert_wrapper(const char *filename, const char *target_file, const char *unused,
+                             const struct jpeg_options *options){
+    printf("calling streamed invert\n");
+    return stream_picture(filename, target_file, STREAM_INVERT, options);
+  }
+
+  bool stream_grayscale_wrapper(const char *filename, const char *target_file, const char *unused,
+                                const struct jpeg_options *options){
+    printf("calling streamed grayscale\n");
+    return stream_picture(filename, target_file, STREAM_GRAYSCALE, options);
+  }
+
+  bool stream_flip_wrapper(const char *filename, const char *target_file, const char *extra_arg,
+                           const struct jpeg_options *options){
+    char plane = extra_arg ? extra_arg[0] : '\0';
+    if(plane != 'H'){
+      return false;
+    }
+    printf("calling streamed flip (%c)\n", plane);
+    return stream_picture(filename, target_file, STREAM_FLIP_H, options);
+  }
+
+  bool stream_blur_wrapper(const char *filename, const char *target_file, const char *unused,
+                           const struct jpeg_options *options){
+    printf("calling streamed blur\n");
+    return stream_picture(filename, target_file, STREAM_BLUR, options);
+  }
+
+  // streamed counterparts of the look-up table entries (NULL where there is none)
+  static bool (* const stream_cmds[])(const char *, const char *, const char *, 
+                                      const struct jpeg_options *) = { 
+    stream_invert_wrapper,
+    stream_grayscale_wrapper,
+    NULL,
+    stream_flip_wrapper,
+    stream_blur_wrapper,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+  };
+
+// ------------ fused point operation chains (e.g. invert+grayscale) ------------ \\
+
+  // Parse a process made of point operations joined by '+' into chain, where
+  // brightness and contrast take their amount as brightness=N (the extra argument
+  // when it is left out). Returns false when a step is not a point operation.
+  bool parse_point_chain(const char *process, const char *extra_arg, struct point_chain *chain){
+    init_point_chain(chain);
+    while(*process != '\0'){
+      size_t len = strcspn(process, "+");
+      const char *value = memchr(process, '=', len);
+      size_t name_len = value ? (size_t) (value - process) : len;
+      const char *amount = value ? value + 1 : extra_arg;
+      bool added;
+
+      if(name_len == 6 && !strncmp(process, "invert", 6)){
+        added = add_point_op(chain, POINT_INVERT, 0, NULL);
+      } else if(name_len == 9 && !strncmp(process, "grayscale", 9)){
+        added = add_point_op(chain, POINT_GRAYSCALE, 0, NULL);
+      } else if(name_len == 10 && !strncmp(process, "brightness", 10)){
+        added = add_point_op(chain, POINT_BRIGHTNESS, amount ? atoi(amount) : 0, NULL);
+      } else if(name_len == 8 && !strncmp(process, "contrast", 8)){
+        added = add_point_op(chain, POINT_CONTRAST, amount ? atoi(amount) : 100, NULL);
+      } else {
+        added = false;
+      }
+      if(!added){
+        return false;
+      }
+
+      process += len;
+      if(*process == '+'){
+        process++;
+      }
+    }
+    return chain->length > 0;
+  }
+
+// ------------ running a process on one picture or a whole directory ------------ \\
+
+  // run the requested transformation on pic (the point chain, when there is one)
+  void apply_process(struct picture *pic, const struct point_chain *chain, int cmd_no,
+                     const char *extra_arg){
+    if(chain != NULL){
+      printf("calling fused point operations (%i)\n", chain->length);
+      apply_point_chain(pic, chain);
+    } else {
+      cmds[cmd_no](pic, extra_arg);
+    }
+  }
+
+  // Process every picture in the directory dir, in file name order, and save the
+  // n-th one as target_dir/n.jpg (creating target_dir when it does not exist).
+  bool process_directory(const char *dir, const char *target_dir, const struct point_chain *chain,
+                         int cmd_no, const char *extra_arg, const struct jpeg_options *jpeg){
+    sod_img *images;
+    int count = load_images_from_directory(dir, &images);
+    if(count == IO_ERROR){
+      return false;
+    }
+    if(mkdir(target_dir, 0777) != 0 && errno != EEXIST){
+      printf("[!] error creating directory %s\n", target_dir);
+      free_images(images, count);
+      return false;
+    }
+    printf("loaded %i pictures from %s\n", count, dir);
+
+    bool ok = true;
+    for(int i = 0; i < count && ok; i++){
+      char path[PATH_MAX];
+      snprintf(path, sizeof(path), "%s/%i.jpg", target_dir, i);
+
+      struct picture pic;
+      ok = init_picture_from_image(&pic, images[i]);
+      if(ok){
+        apply_process(&pic, chain, cmd_no, extra_arg);
+        ok = save_picture_to_file(&pic, path, jpeg);
+        clear_picture(&pic);
+      }
+    }
+    free_images(images, count);
+    return ok;
+  }
+
 
 // ---------- MAIN PROGRAM ---------- \\
 
@@ -75,45 +272,160 @@
     const char * filename = argv[1];
     const char * target_file = argv[2];
     const char * process = argv[3];
-    const char * extra_arg = argv[4];
+    const char * extra_arg = NULL;
     
     if(filename == NULL || target_file == NULL || process == NULL){
       printf("[!] insufficient command line arguments provided\n");
       exit(IO_ERROR);
     }        
+
+    // optional JPEG encoder (and decoder) settings may appear anywhere after the process
+    // (the first other argument is the process' extra argument, any further one is an error)
+    struct jpeg_options jpeg = default_jpeg_options;
+    bool streaming = false;
+    bool pinning = false;
+    int scale = 1;
+    for(int arg = 4; arg < argc; arg++){
+      if(!strcmp(argv[arg], "--quality") && arg + 1 < argc){
+        jpeg.quality = atoi(argv[++arg]);
+        if(jpeg.quality < 1 || jpeg.quality > 100){
+          printf("[!] invalid JPEG quality %s (must be between 1 and 100)\n", argv[arg]);
+          exit(IO_ERROR);
+        }
+      } else if(!strcmp(argv[arg], "--subsample") && arg + 1 < argc){
+        arg++;
+        if(!strcmp(argv[arg], "420")){
+          jpeg.chroma_subsampling = true;
+        } else if(!strcmp(argv[arg], "444")){
+          jpeg.chroma_subsampling = false;
+        } else {
+          printf("[!] invalid chroma subsampling %s (expecting 420 or 444)\n", argv[arg]);
+          exit(IO_ERROR);
+        }
+      } else if(!strcmp(argv[arg], "--scale") && arg + 1 < argc){
+        scale = atoi(argv[++arg]);
+      } else if(!strcmp(argv[arg], "--buffered-output")){
+        jpeg.buffered_output = true;
+      } else if(!strcmp(argv[arg], "--no-buffered-output")){
+        jpeg.buffered_output = false;
+      } else if(!strcmp(argv[arg], "--parallel-encode")){
+        jpeg.parallel_encode = true;
+      } else if(!strcmp(argv[arg], "--no-parallel-encode")){
+        jpeg.parallel_encode = false;
+      } else if(!strcmp(argv[arg], "--lossless")){
+        jpeg.lossless_transform = true;
+      } else if(!strcmp(argv[arg], "--no-lossless")){
+        jpeg.lossless_transform = false;
+      } else if(!strcmp(argv[arg], "--stream")){
+        streaming = true;
+      } else if(!strcmp(argv[arg], "--no-stream")){
+        streaming = false;
+      } else if(!strcmp(argv[arg], "--pin-threads")){
+        pinning = true;
+      } else if(!strcmp(argv[arg], "--no-pin-threads")){
+        pinning = false;
+      } else if(extra_arg == NULL && strncmp(argv[arg], "--", 2)){
+        extra_arg = argv[arg];
+      } else {
+        printf("[!] unknown option %s\n", argv[arg]);
+        exit(IO_ERROR);
+      }
+    }
   
     printf("  filename  = %s\n", filename);
     printf("  target    = %s\n", target_file);
     printf("  process   = %s\n", process);
     printf("  extra arg = %s\n", extra_arg);
+    printf("  jpeg      = quality %i, %s, %s output, %s encode\n", jpeg.quality, 
+           jpeg.chroma_subsampling ? "4:2:0" : "4:4:4", jpeg.buffered_output ? "buffered" : "unbuffered",
+           jpeg.parallel_encode ? "parallel" : "serial");
+    printf("  lossless  = %s\n", jpeg.lossless_transform ? "yes" : "no");
+    printf("  streaming = %s\n", streaming ? "yes" : "no");
+    printf("  pinning   = %s\n", pinning ? "yes" : "no");
+    printf("  scale     = 1/%i\n", scale);
   
     printf("\n");
+
+    // pin the threads of the process-wide pool to cpus (node by node) when asked to
+    if(pinning){
+      thpool_config pool = { 0, 1 };
+      thpool_global_config(&pool);
+    }
   
-    // create original image object
-    struct picture pic;
-    if(!init_picture_from_file(&pic, filename)){
-      exit(IO_ERROR);   
-    }    
-  
-    // identify the picture transformation to run
+    // a chain of point operations is applied in a single pass over the picture,
+    // anything else is looked up in the table of picture transformations
+    struct point_chain chain;
+    bool is_chain = strchr(process, '+') != NULL;
     int cmd_no = 0;
-    while(cmd_no < no_of_cmds && strcmp(process, cmd_strings[cmd_no])){
-      cmd_no++;
+    if(is_chain){
+      if(!parse_point_chain(process, extra_arg, &chain)){
+        printf("[!] invalid process requested: %s is not a chain of point operations (at most %i)\n"
+               "    aborting...\n", process, MAX_POINT_OPS);
+        exit(IO_ERROR);
+      }
+    } else {
+      while(cmd_no < no_of_cmds && strcmp(process, cmd_strings[cmd_no])){
+        cmd_no++;
+      }
+    
+      // IO error check
+      if(cmd_no == no_of_cmds){
+        printf("[!] invalid process requested: %s is not defined\n    aborting...\n", process);  
+        exit(IO_ERROR);   
+      }
+    }
+
+    // a directory as input: every picture in it goes through the pixel path
+    // (target_file names the output directory)
+    if(is_directory(filename)){
+      if(scale != 1){
+        printf("[!] pictures loaded from a directory cannot be scaled\n");
+        exit(IO_ERROR);
+      }
+      if(!process_directory(filename, target_file, is_chain ? &chain : NULL, cmd_no, extra_arg, &jpeg)){
+        exit(IO_ERROR);
+      }
+      printf("-- picture processing complete --\n");
+      thpool_global_shutdown();
+      return 0;
+    }
+
+    // rotate/flip JPEG input in the DCT domain when asked to, falling back to 
+    // the pixel path when the input does not allow it (or has to be scaled)
+    if(!is_chain && jpeg.lossless_transform && scale == 1 && lossless_cmds[cmd_no] != NULL){
+      if(lossless_cmds[cmd_no](filename, target_file, extra_arg)){
+        printf("-- picture processing complete --\n");
+        thpool_global_shutdown();
+        return 0;
+      }
+      printf("lossless transform not possible, using the pixel path\n");
+    }
+
+    // transform a band of rows at a time (never holding the whole picture) when 
+    // asked to and the transformation only needs neighbouring rows
+    if(!is_chain && streaming && scale == 1 && stream_cmds[cmd_no] != NULL){
+      if(stream_cmds[cmd_no](filename, target_file, extra_arg, &jpeg)){
+        printf("-- picture processing complete --\n");
+        thpool_global_shutdown();
+        return 0;
+      }
+      printf("streamed transform not possible, using the pixel path\n");
     }
   
-    // IO error check
-    if(cmd_no == no_of_cmds){
-      printf("[!] invalid process requested: %s is not defined\n    aborting...\n", process);  
+    // create original image object (decoded straight to the requested scale)
+    struct picture pic;
+    if(!init_picture_from_file_scaled(&pic, filename, scale)){
       exit(IO_ERROR);   
-    }
+    }    
   
     // dispatch to appropriate picture transformation function
-    cmds[cmd_no](&pic, extra_arg);
+    apply_process(&pic, is_chain ? &chain : NULL, cmd_no, extra_arg);
 
     // save resulting picture and report success
-    save_picture_to_file(&pic, target_file);
+    save_picture_to_file(&pic, target_file, &jpeg);
     printf("-- picture processing complete --\n");
     
     clear_picture(&pic);
+    thpool_global_shutdown();
     return 0;
   }
@@ -11,19 +11,25 @@
 #if defined(__APPLE__)
 #include <AvailabilityMacros.h>
 #else
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+/* for cpu_set_t and sched_setaffinity */
+#define _GNU_SOURCE
+#endif
 #ifndef _POSIX_C_SOURCE
 #define _POSIX_C_SOURCE 200809L
 #endif
 #endif
 #include <unistd.h>
-#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
 #include <pthread.h>
 #include <errno.h>
-#include <time.h>
+#include <stdatomic.h>
 #if defined(__linux__)
 #include <sys/prctl.h>
+#include <sched.h>
 #endif
 
 #include "Thpool.h"
@@ -40,19 +46,44 @@
 #define err(str)
 #endif
 
-static volatile int threads_keepalive;
-static volatile int threads_on_hold;
+/* Upper bound on chunks per thread handed out by thpool_parallel_for */
+#define THPOOL_CHUNKS_PER_THREAD 4
+
+/* Capacity of each worker's deque, must be a power of two */
+#define THPOOL_DEQUE_SIZE 1024
+
+/* Jobs allocated at once when a pool runs out of free jobs */
+#define THPOOL_SLAB_JOBS 64
+
+/* Free jobs a worker keeps for itself before handing them back to the pool */
+#define THPOOL_JOB_CACHE 64
+
+/* NUMA nodes looked for under /sys/devices/system/node */
+#define THPOOL_MAX_NODES 64
+
+
+/* Where threads outside of any pool start looking for jobs to steal */
+static atomic_uint helper_victim;
+
+/* Worker the calling thread is running as, NULL outside of any pool */
+static _Thread_local struct thread* thread_self = NULL;
+
+static threadpool      global_thpool = NULL;
+static pthread_mutex_t global_thpool_lock = PTHREAD_MUTEX_INITIALIZER;
+static thpool_config   global_thpool_config = { 0, 0 };
 
 
 
 /* ========================== STRUCTURES ============================ */
 
 
-/* Binary semaphore */
+/* Binary semaphore (posts to several threads at once can hold more) */
 typedef struct bsem {
 	pthread_mutex_t mutex;
 	pthread_cond_t   cond;
-	int v;
+	int v;                               /* waits that may return     */
+	int closed;                          /* waits return at once      */
+	int waiting;                         /* threads asleep in wait    */
 } bsem;
 
 
@@ -61,9 +92,19 @@ typedef struct job{
 	struct job*  prev;                   /* pointer to previous job   */
 	void   (*function)(void* arg);       /* function pointer          */
 	void*  arg;                          /* function's argument       */
+	struct thpool_group_* group;         /* group to report to or NULL*/
+	_Alignas(max_align_t)
+	unsigned char inline_arg[THPOOL_INLINE_ARG_SIZE]; /* copied arg   */
 } job;
 
 
+/* Block of jobs, freed all together with the pool */
+typedef struct job_slab{
+	struct job_slab* next;               /* previously allocated slab */
+	job    jobs[THPOOL_SLAB_JOBS];
+} job_slab;
+
+
 /* Job queue */
 typedef struct jobqueue{
 	pthread_mutex_t rwmutex;             /* used for queue r/w access */
@@ -71,25 +112,71 @@ typedef struct jobqueue{
 	job  *rear;                          /* pointer to rear  of queue */
 	bsem *has_jobs;                      /* flag as binary semaphore  */
 	int   len;                           /* number of jobs in queue   */
+	int   posted;                        /* batch wake-ups under way  */
 } jobqueue;
 
 
+/* Work-stealing deque (Chase-Lev, fixed capacity)
+ *
+ * Only the owning worker pushes and pops at the bottom, any other thread
+ * may steal from the top. */
+typedef struct wsdeque{
+	atomic_long    top;                  /* next index to steal       */
+	char           pad[64];              /* keep ends on own lines    */
+	atomic_long    bottom;               /* next index to push        */
+	_Atomic(job*)  buffer[THPOOL_DEQUE_SIZE];
+} wsdeque;
+
+
 /* Thread */
 typedef struct thread{
 	int       id;                        /* friendly id               */
+	int       cpu;                       /* cpu pinned to or -1       */
 	pthread_t pthread;                   /* pointer to actual thread  */
 	struct thpool_* thpool_p;            /* access to thpool          */
+	unsigned int seed;                   /* victim selection state    */
+	job*      free_jobs;                 /* jobs to reuse (prev link) */
+	int       num_free_jobs;             /* length of free_jobs       */
+	wsdeque   deque;                     /* jobs added by this thread */
 } thread;
 
 
+/* Chunk of a parallel for loop */
+typedef struct range_chunk{
+	void (*function)(int, int, void*);   /* function pointer          */
+	void*  arg;                          /* function's argument       */
+	int    start;                        /* first index of the chunk  */
+	int    end;                          /* one past the last index   */
+} range_chunk;
+
+
+/* Task group */
+typedef struct thpool_group_{
+	struct thpool_* thpool_p;            /* pool running the jobs     */
+	atomic_int      pending;             /* jobs added, not finished  */
+	int             done;                /* pending seen at 0         */
+	pthread_mutex_t lock;                /* used for done             */
+	pthread_cond_t  all_done;            /* signal to group wait      */
+} thpool_group_;
+
+
 /* Threadpool */
 typedef struct thpool_{
 	thread**   threads;                  /* pointer to threads        */
+	int        num_threads;              /* threads created           */
 	volatile int num_threads_alive;      /* threads currently alive   */
 	volatile int num_threads_working;    /* threads currently working */
 	pthread_mutex_t  thcount_lock;       /* used for thread count etc */
 	pthread_cond_t  threads_all_idle;    /* signal to thpool_wait     */
+	pthread_cond_t  threads_all_alive;   /* signal to thpool_init     */
+	pthread_cond_t  resumed;             /* signal to held threads    */
+	atomic_int keepalive;                /* 0 once destroy started    */
+	atomic_int on_hold;                  /* set by thpool_pause       */
+	atomic_int num_jobs_pending;         /* jobs added, not finished  */
 	jobqueue  jobqueue;                  /* job queue                 */
+	pthread_mutex_t  jobs_lock;          /* used for free_jobs, slabs */
+	job*      free_jobs;                 /* jobs to reuse (prev link) */
+	job_slab* slabs;                     /* all jobs of the pool      */
 } thpool_;
 
 
@@ -99,22 +186,46 @@ typedef struct thpool_{
 /* ========================== PROTOTYPES ============================ */
 
 
-static int  thread_init(thpool_* thpool_p, struct thread** thread_p, int id);
+static int  thread_init(thpool_* thpool_p, struct thread** thread_p, int id, int cpu);
+static void thread_pin(struct thread* thread_p);
+static int  cpu_topology(int* cpus_p, int max_cpus);
 static void* thread_do(struct thread* thread_p);
-static void  thread_hold(int sig_id);
+static void  thread_hold(thpool_* thpool_p);
 static void  thread_destroy(struct thread* thread_p);
+static struct job* thread_next_job(struct thread* thread_p);
+static struct job* thread_steal(struct thread* thread_p);
+
+static int   job_submit(thpool_* thpool_p, void (*function_p)(void*), void* arg_p, size_t arg_size,
+                        thpool_group_* group_p);
+static void  job_run(thpool_* thpool_p, struct job* job_p);
+static struct job* job_alloc(thpool_* thpool_p);
+static struct job* job_alloc_batch(thpool_* thpool_p, int num_jobs);
+static void  job_enqueue_batch(thpool_* thpool_p, struct job* first_p, int num_jobs, thpool_group_* group_p);
+static void  job_release(thpool_* thpool_p, struct job* job_p);
+static void  job_slabs_free(thpool_* thpool_p);
+static int   group_submit(thpool_group_* group_p, void (*function_p)(void*), void* arg_p, size_t arg_size);
+static struct job* job_find(thpool_* thpool_p);
+
+static void  range_chunk_run(struct range_chunk* chunk_p);
 
 static int   jobqueue_init(jobqueue* jobqueue_p);
 static void  jobqueue_clear(jobqueue* jobqueue_p);
 static void  jobqueue_push(jobqueue* jobqueue_p, struct job* newjob_p);
+static void  jobqueue_push_batch(jobqueue* jobqueue_p, struct job* first_p, struct job* last_p, int num_jobs);
 static struct job* jobqueue_pull(jobqueue* jobqueue_p);
 static void  jobqueue_destroy(jobqueue* jobqueue_p);
 
+static void  wsdeque_init(wsdeque* wsdeque_p);
+static int   wsdeque_push(wsdeque* wsdeque_p, struct job* newjob_p);
+static struct job* wsdeque_pop(wsdeque* wsdeque_p);
+static struct job* wsdeque_steal(wsdeque* wsdeque_p);
+
 static void  bsem_init(struct bsem *bsem_p, int value);
 static void  bsem_reset(struct bsem *bsem_p);
 static void  bsem_post(struct bsem *bsem_p);
-static void  bsem_post_all(struct bsem *bsem_p);
+static int   bsem_post_many(struct bsem *bsem_p, int num_posts);
 static void  bsem_wait(struct bsem *bsem_p);
+static void  bsem_close(struct bsem *bsem_p);
 
 
 
@@ -125,9 +236,14 @@ static void  bsem_wait(struct bsem *bsem_p);
 
 /* Initialise thread pool */
 struct thpool_* thpool_init(int num_threads){
+	thpool_config config = { num_threads, 0 };
+	return thpool_init_config(&config);
+}
 
-	threads_on_hold   = 0;
-	threads_keepalive = 1;
+
+/* Initialise thread pool with the given settings */
+struct thpool_* thpool_init_config(const thpool_config* config_p){
+	int num_threads = config_p->num_threads;
 
 	if (num_threads < 0){
 		num_threads = 0;
@@ -142,6 +258,11 @@ struct thpool_* thpool_init(int num_threads){
 	}
 	thpool_p->num_threads_alive   = 0;
 	thpool_p->num_threads_working = 0;
+	atomic_init(&thpool_p->keepalive, 1);
+	atomic_init(&thpool_p->on_hold, 0);
+	atomic_init(&thpool_p->num_jobs_pending, 0);
+	thpool_p->free_jobs = NULL;
+	thpool_p->slabs     = NULL;
 
 	/* Initialise the job queue */
 	if (jobqueue_init(&thpool_p->jobqueue) == -1){
@@ -152,27 +273,55 @@ struct thpool_* thpool_init(int num_threads){
 
 	/* Make threads in pool */
 	thpool_p->threads = (struct thread**)malloc(num_threads * sizeof(struct thread *));
-	if (thpool_p->threads == NULL){
+	if (thpool_p->threads == NULL && num_threads > 0){
 		err("thpool_init(): Could not allocate memory for threads\n");
 		jobqueue_destroy(&thpool_p->jobqueue);
 		free(thpool_p);
 		return NULL;
 	}
 
+	thpool_p->num_threads = num_threads;
+
 	pthread_mutex_init(&(thpool_p->thcount_lock), NULL);
+	pthread_mutex_init(&(thpool_p->jobs_lock), NULL);
 	pthread_cond_init(&thpool_p->threads_all_idle, NULL);
+	pthread_cond_init(&thpool_p->threads_all_alive, NULL);
+	pthread_cond_init(&thpool_p->resumed, NULL);
+
+	/* Lay the threads out over the cpus, filling one NUMA node after the other */
+	int* cpus_p = NULL;
+	int num_cpus = 0;
+	if (config_p->pin_threads && num_threads > 0){
+		cpus_p = (int*)malloc(num_threads * sizeof(int));
+		if (cpus_p != NULL){
+			num_cpus = cpu_topology(cpus_p, num_threads);
+		}
+		if (num_cpus == 0){
+			err("thpool_init(): Could not read the cpu topology, threads are not pinned\n");
+		}
+	}
 
 	/* Thread init */
 	int n;
 	for (n=0; n<num_threads; n++){
-		thread_init(thpool_p, &thpool_p->threads[n], n);
+		int cpu = num_cpus > 0 ? cpus_p[n % num_cpus] : -1;
+		if (thread_init(thpool_p, &thpool_p->threads[n], n, cpu) == -1){
+			/* carry on with the threads we have */
+			break;
+		}
 #if THPOOL_DEBUG
 			printf("THPOOL_DEBUG: Created thread %d in pool \n", n);
 #endif
 	}
+	thpool_p->num_threads = n;
+	free(cpus_p);
 
 	/* Wait for threads to initialize */
-	while (thpool_p->num_threads_alive != num_threads) {}
+	pthread_mutex_lock(&thpool_p->thcount_lock);
+	while (thpool_p->num_threads_alive != thpool_p->num_threads) {
+		pthread_cond_wait(&thpool_p->threads_all_alive, &thpool_p->thcount_lock);
+	}
+	pthread_mutex_unlock(&thpool_p->thcount_lock);
 
 	return thpool_p;
 }
@@ -180,29 +329,196 @@ struct thpool_* thpool_init(int num_threads){
 
 /* Add work to the thread pool */
 int thpool_add_work(thpool_* thpool_p, void (*function_p)(void*), void* arg_p){
-	job* newjob;
+	return job_submit(thpool_p, function_p, arg_p, 0, NULL);
+}
 
-	newjob=(struct job*)malloc(sizeof(struct job));
-	if (newjob==NULL){
-		err("thpool_add_work(): Could not allocate memory for new job\n");
+
+/* Add work to the thread pool with a copy of its argument */
+int thpool_add_work_inline(thpool_* thpool_p, void (*function_p)(void*), const void* arg_p, size_t arg_size){
+	if (arg_size > THPOOL_INLINE_ARG_SIZE){
+		err("thpool_add_work_inline(): Argument does not fit in a job\n");
 		return -1;
 	}
+	return job_submit(thpool_p, function_p, (void*)arg_p, arg_size, NULL);
+}
 
-	/* add function and argument */
-	newjob->function=function_p;
-	newjob->arg=arg_p;
 
-	/* add job to queue */
-	jobqueue_push(&thpool_p->jobqueue, newjob);
+/* Add one job per argument to the thread pool in one go */
+int thpool_add_work_batch(thpool_* thpool_p, void (*function_p)(void*), void** args_p, int num_jobs){
+	if (num_jobs <= 0){
+		return 0;
+	}
+	job* first_p = job_alloc_batch(thpool_p, num_jobs);
+	if (first_p == NULL){
+		err("thpool_add_work_batch(): Could not allocate memory for new jobs\n");
+		return -1;
+	}
 
+	job* job_p = first_p;
+	int n;
+	for (n=0; n<num_jobs; n++, job_p = job_p->prev){
+		job_p->function = function_p;
+		job_p->arg      = args_p[n];
+	}
+	job_enqueue_batch(thpool_p, first_p, num_jobs, NULL);
 	return 0;
 }
 
 
+/* Run function over [begin, end) split into a bounded number of chunks */
+int thpool_parallel_for(thpool_* thpool_p, int begin, int end, int grain,
+                        void (*function_p)(int, int, void*), void* arg_p){
+	if (end <= begin){
+		return 0;
+	}
+	if (grain < 1){
+		grain = 1;
+	}
+
+	/* Size chunks so that there are at most THPOOL_CHUNKS_PER_THREAD per thread */
+	int threads = thpool_p ? thpool_p->num_threads : 0;
+	int len = end - begin;
+	int max_chunks = threads * THPOOL_CHUNKS_PER_THREAD;
+	int chunk_len = grain;
+	if (max_chunks > 0 && (len + max_chunks - 1) / max_chunks > chunk_len){
+		chunk_len = (len + max_chunks - 1) / max_chunks;
+	}
+	int num_chunks = (len + chunk_len - 1) / chunk_len;
+
+	/* Not worth a round trip through the pool */
+	if (threads < 1 || num_chunks < 2){
+		function_p(begin, end, arg_p);
+		return 0;
+	}
+
+	thpool_group_* group_p = thpool_group_init(thpool_p);
+	if (group_p == NULL){
+		return -1;
+	}
+
+	/* Each chunk travels inside its job. Workers of the pool push them to their
+	 * own deque, other threads hand them all to the queue at once. */
+	int n;
+	if (thread_self == NULL || thread_self->thpool_p != thpool_p){
+		job* first_p = job_alloc_batch(thpool_p, num_chunks);
+		if (first_p != NULL){
+			job* job_p = first_p;
+			for (n=0; n<num_chunks; n++, job_p = job_p->prev){
+				range_chunk* chunk_p = (struct range_chunk*)job_p->inline_arg;
+				chunk_p->function = function_p;
+				chunk_p->arg      = arg_p;
+				chunk_p->start    = begin + n * chunk_len;
+				chunk_p->end      = chunk_p->start + chunk_len < end ? chunk_p->start + chunk_len : end;
+				job_p->function   = (void (*)(void*))range_chunk_run;
+				job_p->arg        = chunk_p;
+			}
+			job_enqueue_batch(thpool_p, first_p, num_chunks, group_p);
+			thpool_group_wait(group_p);
+			thpool_group_destroy(group_p);
+			return 0;
+		}
+	}
+	for (n=0; n<num_chunks; n++){
+		range_chunk chunk;
+		chunk.function = function_p;
+		chunk.arg      = arg_p;
+		chunk.start    = begin + n * chunk_len;
+		chunk.end      = chunk.start + chunk_len < end ? chunk.start + chunk_len : end;
+
+		/* Fall back to running the chunk on the calling thread */
+		if (group_submit(group_p, (void (*)(void*))range_chunk_run, &chunk, sizeof(chunk)) == -1){
+			range_chunk_run(&chunk);
+		}
+	}
+
+	thpool_group_wait(group_p);
+	thpool_group_destroy(group_p);
+	return 0;
+}
+
+
+/* Make a task group on the thread pool */
+struct thpool_group_* thpool_group_init(thpool_* thpool_p){
+	thpool_group_* group_p = (struct thpool_group_*)malloc(sizeof(struct thpool_group_));
+	if (group_p == NULL){
+		err("thpool_group_init(): Could not allocate memory for task group\n");
+		return NULL;
+	}
+	group_p->thpool_p = thpool_p;
+	atomic_init(&group_p->pending, 0);
+	group_p->done = 1;
+	pthread_mutex_init(&group_p->lock, NULL);
+	pthread_cond_init(&group_p->all_done, NULL);
+	return group_p;
+}
+
+
+/* Add work to the thread pool on behalf of a task group */
+int thpool_group_add_work(thpool_group_* group_p, void (*function_p)(void*), void* arg_p){
+	return group_submit(group_p, function_p, arg_p, 0);
+}
+
+
+/* Count a job against a task group and queue it */
+static int group_submit(thpool_group_* group_p, void (*function_p)(void*), void* arg_p, size_t arg_size){
+	if (atomic_fetch_add(&group_p->pending, 1) == 0){
+		pthread_mutex_lock(&group_p->lock);
+		group_p->done = 0;
+		pthread_mutex_unlock(&group_p->lock);
+	}
+
+	if (job_submit(group_p->thpool_p, function_p, arg_p, arg_size, group_p) == -1){
+		/* undo the count, nothing will report back for this job */
+		if (atomic_fetch_sub(&group_p->pending, 1) == 1){
+			pthread_mutex_lock(&group_p->lock);
+			group_p->done = (atomic_load(&group_p->pending) == 0);
+			pthread_cond_broadcast(&group_p->all_done);
+			pthread_mutex_unlock(&group_p->lock);
+		}
+		return -1;
+	}
+	return 0;
+}
+
+
+/* Wait until all jobs of a task group have finished, running jobs meanwhile */
+void thpool_group_wait(thpool_group_* group_p){
+	thpool_* thpool_p = group_p->thpool_p;
+
+	/* Help out instead of going to sleep */
+	while (atomic_load(&group_p->pending) > 0){
+		job* job_p = job_find(thpool_p);
+		if (job_p == NULL){
+			break;
+		}
+		job_run(thpool_p, job_p);
+	}
+
+	/* The remaining jobs are running elsewhere */
+	pthread_mutex_lock(&group_p->lock);
+	while (!group_p->done){
+		pthread_cond_wait(&group_p->all_done, &group_p->lock);
+	}
+	pthread_mutex_unlock(&group_p->lock);
+}
+
+
+/* Free a task group */
+void thpool_group_destroy(thpool_group_* group_p){
+	if (group_p == NULL) return ;
+
+	pthread_mutex_destroy(&group_p->lock);
+	pthread_cond_destroy(&group_p->all_done);
+	free(group_p);
+}
+
+
 /* Wait until all jobs have finished */
 void thpool_wait(thpool_* thpool_p){
+	/* Jobs may sit in the queue or in any worker's deque (e.g. when the pool
+	 * is paused), count them wherever they are */
 	pthread_mutex_lock(&thpool_p->thcount_lock);
-	while (thpool_p->jobqueue.len || thpool_p->num_threads_working) {
+	while (atomic_load(&thpool_p->num_jobs_pending) > 0) {
 		pthread_cond_wait(&thpool_p->threads_all_idle, &thpool_p->thcount_lock);
 	}
 	pthread_mutex_unlock(&thpool_p->thcount_lock);
@@ -214,35 +530,31 @@ void thpool_destroy(thpool_* thpool_p){
 	/* No need to destory if it's NULL */
 	if (thpool_p == NULL) return ;
 
-	volatile int threads_total = thpool_p->num_threads_alive;
-
-	/* End each thread 's infinite loop */
-	threads_keepalive = 0;
-
-	/* Give one second to kill idle threads */
-	double TIMEOUT = 1.0;
-	time_t start, end;
-	double tpassed = 0.0;
-	time (&start);
-	while (tpassed < TIMEOUT && thpool_p->num_threads_alive){
-		bsem_post_all(thpool_p->jobqueue.has_jobs);
-		time (&end);
-		tpassed = difftime(end,start);
-	}
+	/* End each thread 's infinite loop, other pools keep running */
+	pthread_mutex_lock(&thpool_p->thcount_lock);
+	atomic_store(&thpool_p->keepalive, 0);
+	pthread_cond_broadcast(&thpool_p->resumed);
+	pthread_mutex_unlock(&thpool_p->thcount_lock);
 
-	/* Poll remaining threads */
-	while (thpool_p->num_threads_alive){
-		bsem_post_all(thpool_p->jobqueue.has_jobs);
-		sleep(1);
+	/* Wake every idle thread for good and wait for all of them to exit */
+	bsem_close(thpool_p->jobqueue.has_jobs);
+	int n;
+	for (n=0; n < thpool_p->num_threads; n++){
+		pthread_join(thpool_p->threads[n]->pthread, NULL);
 	}
 
 	/* Job queue cleanup */
 	jobqueue_destroy(&thpool_p->jobqueue);
 	/* Deallocs */
-	int n;
-	for (n=0; n < threads_total; n++){
+	for (n=0; n < thpool_p->num_threads; n++){
 		thread_destroy(thpool_p->threads[n]);
 	}
+	job_slabs_free(thpool_p);
+	pthread_mutex_destroy(&thpool_p->thcount_lock);
+	pthread_mutex_destroy(&thpool_p->jobs_lock);
+	pthread_cond_destroy(&thpool_p->threads_all_idle);
+	pthread_cond_destroy(&thpool_p->threads_all_alive);
+	pthread_cond_destroy(&thpool_p->resumed);
 	free(thpool_p->threads);
 	free(thpool_p);
 }
@@ -250,21 +562,19 @@ void thpool_destroy(thpool_* thpool_p){
 
 /* Pause all threads in threadpool */
 void thpool_pause(thpool_* thpool_p) {
-	int n;
-	for (n=0; n < thpool_p->num_threads_alive; n++){
-		pthread_kill(thpool_p->threads[n]->pthread, SIGUSR1);
-	}
+	atomic_store(&thpool_p->on_hold, 1);
 }
 
 
 /* Resume all threads in threadpool */
 void thpool_resume(thpool_* thpool_p) {
-    // resuming a single threadpool hasn't been
-    // implemented yet, meanwhile this supresses
-    // the warnings
-    (void)thpool_p;
+	pthread_mutex_lock(&thpool_p->thcount_lock);
+	atomic_store(&thpool_p->on_hold, 0);
+	pthread_cond_broadcast(&thpool_p->resumed);
+	pthread_mutex_unlock(&thpool_p->thcount_lock);
 
-	threads_on_hold = 0;
+	/* work may have been added meanwhile */
+	bsem_post(thpool_p->jobqueue.has_jobs);
 }
 
 
@@ -273,6 +583,53 @@ int thpool_num_threads_working(thpool_* thpool_p){
 }
 
 
+int thpool_num_threads(thpool_* thpool_p){
+	return thpool_p->num_threads;
+}
+
+
+/* Set up the process-wide thread pool before it is first used */
+int thpool_global_config(const thpool_config* config_p){
+	pthread_mutex_lock(&global_thpool_lock);
+	int rc = -1;
+	if (global_thpool == NULL){
+		global_thpool_config = *config_p;
+		rc = 0;
+	}
+	pthread_mutex_unlock(&global_thpool_lock);
+	return rc;
+}
+
+
+/* Get (and lazily create) the process-wide thread pool */
+struct thpool_* thpool_global(void){
+	pthread_mutex_lock(&global_thpool_lock);
+	if (global_thpool == NULL){
+		thpool_config config = global_thpool_config;
+		if (config.num_threads < 1){
+			long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+			config.num_threads = num_cpus < 1 ? 1 : (int)num_cpus;
+		}
+		global_thpool = thpool_init_config(&config);
+	}
+	thpool_* thpool_p = global_thpool;
+	pthread_mutex_unlock(&global_thpool_lock);
+	return thpool_p;
+}
+
+
+/* Wait for and destroy the process-wide thread pool */
+void thpool_global_shutdown(void){
+	pthread_mutex_lock(&global_thpool_lock);
+	if (global_thpool != NULL){
+		thpool_wait(global_thpool);
+		thpool_destroy(global_thpool);
+		global_thpool = NULL;
+	}
+	pthread_mutex_unlock(&global_thpool_lock);
+}
+
+
 
 
 
@@ -283,9 +640,10 @@ int thpool_num_threads_working(thpool_* thpool_p){
  *
  * @param thread        address to the pointer of the thread to be created
  * @param id            id to be given to the thread
+ * @param cpu           cpu to pin the thread to, -1 to let it float
  * @return 0 on success, -1 otherwise.
  */
-static int thread_init (thpool_* thpool_p, struct thread** thread_p, int id){
+static int thread_init (thpool_* thpool_p, struct thread** thread_p, int id, int cpu){
 
 	*thread_p = (struct thread*)malloc(sizeof(struct thread));
 	if (*thread_p == NULL){
@@ -295,20 +653,36 @@ static int thread_init (thpool_* thpool_p, struct thread** thread_p, int id){
 
 	(*thread_p)->thpool_p = thpool_p;
 	(*thread_p)->id       = id;
-
-	pthread_create(&(*thread_p)->pthread, NULL, (void * (*)(void *)) thread_do, (*thread_p));
-	pthread_detach((*thread_p)->pthread);
+	(*thread_p)->cpu      = cpu;
+	(*thread_p)->seed     = (unsigned int)id * 2654435761u + 1;
+	(*thread_p)->free_jobs     = NULL;
+	(*thread_p)->num_free_jobs = 0;
+	wsdeque_init(&(*thread_p)->deque);
+
+	/* joined by thpool_destroy */
+	if (pthread_create(&(*thread_p)->pthread, NULL, (void * (*)(void *)) thread_do, (*thread_p)) != 0){
+		err("thread_init(): Could not create thread\n");
+		free(*thread_p);
+		*thread_p = NULL;
+		return -1;
+	}
 	return 0;
 }
 
 
-/* Sets the calling thread on hold */
-static void thread_hold(int sig_id) {
-    (void)sig_id;
-	threads_on_hold = 1;
-	while (threads_on_hold){
-		sleep(1);
+/* Hold the calling worker while its pool is paused
+ *
+ * Only called between jobs, a running job is never interrupted.
+ */
+static void thread_hold(thpool_* thpool_p) {
+	if (!atomic_load(&thpool_p->on_hold)){
+		return;
 	}
+	pthread_mutex_lock(&thpool_p->thcount_lock);
+	while (atomic_load(&thpool_p->on_hold) && atomic_load(&thpool_p->keepalive)){
+		pthread_cond_wait(&thpool_p->resumed, &thpool_p->thcount_lock);
+	}
+	pthread_mutex_unlock(&thpool_p->thcount_lock);
 }
 
 
@@ -337,47 +711,37 @@ static void* thread_do(struct thread* thread_p){
 
 	/* Assure all threads have been created before starting serving */
 	thpool_* thpool_p = thread_p->thpool_p;
-
-	/* Register signal handler */
-	struct sigaction act;
-	sigemptyset(&act.sa_mask);
-	act.sa_flags = 0;
-	act.sa_handler = thread_hold;
-	if (sigaction(SIGUSR1, &act, NULL) == -1) {
-		err("thread_do(): cannot handle SIGUSR1");
-	}
+	thread_self = thread_p;
+	thread_pin(thread_p);
 
 	/* Mark thread as alive (initialized) */
 	pthread_mutex_lock(&thpool_p->thcount_lock);
 	thpool_p->num_threads_alive += 1;
+	pthread_cond_signal(&thpool_p->threads_all_alive);
 	pthread_mutex_unlock(&thpool_p->thcount_lock);
 
-	while(threads_keepalive){
+	while(atomic_load(&thpool_p->keepalive)){
 
 		bsem_wait(thpool_p->jobqueue.has_jobs);
+		thread_hold(thpool_p);
 
-		if (threads_keepalive){
+		if (atomic_load(&thpool_p->keepalive)){
 
 			pthread_mutex_lock(&thpool_p->thcount_lock);
 			thpool_p->num_threads_working++;
 			pthread_mutex_unlock(&thpool_p->thcount_lock);
 
-			/* Read job from queue and execute it */
-			void (*func_buff)(void*);
-			void*  arg_buff;
-			job* job_p = jobqueue_pull(&thpool_p->jobqueue);
-			if (job_p) {
-				func_buff = job_p->function;
-				arg_buff  = job_p->arg;
-				func_buff(arg_buff);
-				free(job_p);
+			/* Read jobs from the deques and queue and execute them until all are dry
+			 * or the pool is paused or destroyed (jobs that never ran are freed with
+			 * the queue and the pool's slabs) */
+			job* job_p;
+			while (!atomic_load(&thpool_p->on_hold) && atomic_load(&thpool_p->keepalive) &&
+			       (job_p = thread_next_job(thread_p)) != NULL) {
+				job_run(thpool_p, job_p);
 			}
 
 			pthread_mutex_lock(&thpool_p->thcount_lock);
 			thpool_p->num_threads_working--;
-			if (!thpool_p->num_threads_working) {
-				pthread_cond_signal(&thpool_p->threads_all_idle);
-			}
 			pthread_mutex_unlock(&thpool_p->thcount_lock);
 
 		}
@@ -390,7 +754,155 @@ static void* thread_do(struct thread* thread_p){
 }
 
 
-/* Frees a thread  */
+/* Pin the calling worker to its cpu, if it has one
+ *
+ * Done by the thread itself before it is counted alive, so that whatever
+ * it allocates and first touches lands on its own NUMA node.
+ */
+static void thread_pin(thread* thread_p){
+	if (thread_p->cpu < 0){
+		return;
+	}
+#if defined(__linux__)
+	cpu_set_t cpuset;
+	CPU_ZERO(&cpuset);
+	CPU_SET(thread_p->cpu, &cpuset);
+	if (sched_setaffinity(0, sizeof(cpuset), &cpuset) == -1){
+		err("thread_pin(): Could not pin thread to its cpu\n");
+		thread_p->cpu = -1;
+	}
+#else
+	thread_p->cpu = -1;
+#endif
+}
+
+
+/* List up to max_cpus cpus the process may run on, grouped per NUMA node
+ *
+ * Nodes are read from /sys/devices/system/node, cpus not found there (or
+ * all of them without NUMA support) are listed after them.
+ *
+ * @return number of cpus listed, 0 if the topology is not available
+ */
+static int cpu_topology(int* cpus_p, int max_cpus){
+#if defined(__linux__)
+	cpu_set_t allowed, listed;
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1){
+		return 0;
+	}
+	CPU_ZERO(&listed);
+
+	int num_cpus = 0;
+	int node;
+	for (node=0; node<THPOOL_MAX_NODES && num_cpus<max_cpus; node++){
+		char path[64];
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+		FILE* file_p = fopen(path, "r");
+		if (file_p == NULL){
+			continue;
+		}
+
+		/* ranges such as 0-3,8-11 */
+		int first, last;
+		while (num_cpus < max_cpus && fscanf(file_p, "%d", &first) == 1){
+			last = first;
+			int c = fgetc(file_p);
+			if (c == '-'){
+				if (fscanf(file_p, "%d", &last) != 1){
+					break;
+				}
+				c = fgetc(file_p);
+			}
+			int cpu;
+			for (cpu=first; cpu<=last && cpu<CPU_SETSIZE && num_cpus<max_cpus; cpu++){
+				if (CPU_ISSET(cpu, &allowed) && !CPU_ISSET(cpu, &listed)){
+					CPU_SET(cpu, &listed);
+					cpus_p[num_cpus] = cpu;
+					num_cpus++;
+				}
+			}
+			if (c != ','){
+				break;
+			}
+		}
+		fclose(file_p);
+	}
+
+	int cpu;
+	for (cpu=0; cpu<CPU_SETSIZE && num_cpus<max_cpus; cpu++){
+		if (CPU_ISSET(cpu, &allowed) && !CPU_ISSET(cpu, &listed)){
+			cpus_p[num_cpus] = cpu;
+			num_cpus++;
+		}
+	}
+	return num_cpus;
+#else
+	(void)cpus_p;
+	(void)max_cpus;
+	return 0;
+#endif
+}
+
+
+/* Runs a single chunk of a parallel for loop */
+static void range_chunk_run(range_chunk* chunk_p){
+	chunk_p->function(chunk_p->start, chunk_p->end, chunk_p->arg);
+}
+
+
+/* Get the next job for a worker
+ *
+ * Jobs are taken from the worker's own deque first (most recently added
+ * first), then from the global queue and finally stolen from other workers.
+ *
+ * @param  thread        worker looking for work
+ * @return job to run, NULL if no job was found
+ */
+static struct job* thread_next_job(thread* thread_p){
+	job* job_p = wsdeque_pop(&thread_p->deque);
+	if (job_p == NULL){
+		job_p = jobqueue_pull(&thread_p->thpool_p->jobqueue);
+	}
+	if (job_p == NULL){
+		job_p = thread_steal(thread_p);
+	}
+	return job_p;
+}
+
+
+/* Steal the oldest job of another worker, starting at a random victim */
+static struct job* thread_steal(thread* thread_p){
+	thpool_* thpool_p = thread_p->thpool_p;
+	int num_threads = thpool_p->num_threads;
+	if (num_threads < 2){
+		return NULL;
+	}
+
+	/* xorshift32 */
+	unsigned int x = thread_p->seed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	thread_p->seed = x;
+
+	int n;
+	int victim = (int)(x % (unsigned int)num_threads);
+	for (n=0; n<num_threads; n++, victim = (victim + 1) % num_threads){
+		if (victim == thread_p->id){
+			continue;
+		}
+		job* job_p = wsdeque_steal(&thpool_p->threads[victim]->deque);
+		if (job_p != NULL){
+			/* there may be more where that came from, wake another thief */
+			bsem_post(thpool_p->jobqueue.has_jobs);
+			return job_p;
+		}
+	}
+	return NULL;
+}
+
+
+/* Frees a thread (its jobs go with the pool's slabs) */
 static void thread_destroy (thread* thread_p){
 	free(thread_p);
 }
@@ -399,12 +911,266 @@ static void thread_destroy (thread* thread_p){
 
 
 
+/* ============================== JOB =============================== */
+
+
+/* Make a job and queue it
+ *
+ * Jobs added by a worker of the pool go to that worker's own deque, all
+ * others to the global queue.
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+static int job_submit(thpool_* thpool_p, void (*function_p)(void*), void* arg_p, size_t arg_size,
+                      thpool_group_* group_p){
+	job* newjob;
+
+	newjob=job_alloc(thpool_p);
+	if (newjob==NULL){
+		err("thpool_add_work(): Could not allocate memory for new job\n");
+		return -1;
+	}
+
+	/* add function and argument (a copy of it for a non zero arg_size) */
+	newjob->function=function_p;
+	newjob->arg=arg_p;
+	newjob->group=group_p;
+	if (arg_size > 0){
+		memcpy(newjob->inline_arg, arg_p, arg_size);
+		newjob->arg=newjob->inline_arg;
+	}
+	atomic_fetch_add(&thpool_p->num_jobs_pending, 1);
+
+	thread* self_p = thread_self;
+	if (self_p != NULL && self_p->thpool_p == thpool_p &&
+	    wsdeque_push(&self_p->deque, newjob) == 0){
+		/* let an idle worker come and steal it */
+		bsem_post(thpool_p->jobqueue.has_jobs);
+		return 0;
+	}
+
+	/* add job to queue */
+	jobqueue_push(&thpool_p->jobqueue, newjob);
+
+	return 0;
+}
+
+
+/* Execute a job, report it to its group and free it */
+static void job_run(thpool_* thpool_p, job* job_p){
+	thpool_group_* group_p = job_p->group;
+
+	job_p->function(job_p->arg);
+	job_release(thpool_p, job_p);
+
+	if (group_p != NULL && atomic_fetch_sub(&group_p->pending, 1) == 1){
+		/* last one out, but work may have been added to the group meanwhile */
+		pthread_mutex_lock(&group_p->lock);
+		group_p->done = (atomic_load(&group_p->pending) == 0);
+		pthread_cond_broadcast(&group_p->all_done);
+		pthread_mutex_unlock(&group_p->lock);
+	}
+
+	if (atomic_fetch_sub(&thpool_p->num_jobs_pending, 1) == 1){
+		/* last job of the pool, let thpool_wait return */
+		pthread_mutex_lock(&thpool_p->thcount_lock);
+		pthread_cond_broadcast(&thpool_p->threads_all_idle);
+		pthread_mutex_unlock(&thpool_p->thcount_lock);
+	}
+}
+
+
+/* Get a job to fill in
+ *
+ * Workers reuse the jobs they ran themselves first, everyone else takes
+ * them from the pool, which grows by a slab of jobs whenever it runs out.
+ */
+static struct job* job_alloc(thpool_* thpool_p){
+	thread* self_p = thread_self;
+	job* job_p;
+	if (self_p != NULL && self_p->thpool_p == thpool_p && self_p->free_jobs != NULL){
+		job_p = self_p->free_jobs;
+		self_p->free_jobs = job_p->prev;
+		self_p->num_free_jobs--;
+		return job_p;
+	}
+
+	pthread_mutex_lock(&thpool_p->jobs_lock);
+	if (thpool_p->free_jobs == NULL){
+		job_slab* slab_p = (struct job_slab*)malloc(sizeof(struct job_slab));
+		if (slab_p == NULL){
+			pthread_mutex_unlock(&thpool_p->jobs_lock);
+			return NULL;
+		}
+		slab_p->next = thpool_p->slabs;
+		thpool_p->slabs = slab_p;
+
+		int n;
+		for (n=0; n<THPOOL_SLAB_JOBS; n++){
+			slab_p->jobs[n].prev = thpool_p->free_jobs;
+			thpool_p->free_jobs = &slab_p->jobs[n];
+		}
+	}
+	job_p = thpool_p->free_jobs;
+	thpool_p->free_jobs = job_p->prev;
+	pthread_mutex_unlock(&thpool_p->jobs_lock);
+	return job_p;
+}
+
+
+/* Get num_jobs jobs to fill in, linked through prev
+ *
+ * Takes the jobs from the calling worker's cache and then from the pool
+ * under a single lock, NULL if they cannot all be allocated.
+ */
+static struct job* job_alloc_batch(thpool_* thpool_p, int num_jobs){
+	thread* self_p = thread_self;
+	job* first_p = NULL;
+	int n = 0;
+	if (self_p != NULL && self_p->thpool_p == thpool_p){
+		while (n < num_jobs && self_p->free_jobs != NULL){
+			job* job_p = self_p->free_jobs;
+			self_p->free_jobs = job_p->prev;
+			self_p->num_free_jobs--;
+			job_p->prev = first_p;
+			first_p = job_p;
+			n++;
+		}
+	}
+
+	pthread_mutex_lock(&thpool_p->jobs_lock);
+	for (; n<num_jobs; n++){
+		if (thpool_p->free_jobs == NULL){
+			job_slab* slab_p = (struct job_slab*)malloc(sizeof(struct job_slab));
+			if (slab_p == NULL){
+				break;
+			}
+			slab_p->next = thpool_p->slabs;
+			thpool_p->slabs = slab_p;
+
+			int k;
+			for (k=0; k<THPOOL_SLAB_JOBS; k++){
+				slab_p->jobs[k].prev = thpool_p->free_jobs;
+				thpool_p->free_jobs = &slab_p->jobs[k];
+			}
+		}
+		job* job_p = thpool_p->free_jobs;
+		thpool_p->free_jobs = job_p->prev;
+		job_p->prev = first_p;
+		first_p = job_p;
+	}
+
+	if (n < num_jobs){
+		/* give back what we got */
+		while (first_p != NULL){
+			job* job_p = first_p;
+			first_p = job_p->prev;
+			job_p->prev = thpool_p->free_jobs;
+			thpool_p->free_jobs = job_p;
+		}
+	}
+	pthread_mutex_unlock(&thpool_p->jobs_lock);
+	return first_p;
+}
+
+
+/* Queue a list of filled in jobs from job_alloc_batch()
+ *
+ * The jobs are linked into the queue under one lock and at most one idle
+ * thread per job is woken.
+ */
+static void job_enqueue_batch(thpool_* thpool_p, job* first_p, int num_jobs, thpool_group_* group_p){
+	job* last_p = first_p;
+	int n;
+	for (n=0; n<num_jobs; n++){
+		last_p->group = group_p;
+		if (n + 1 < num_jobs){
+			last_p = last_p->prev;
+		}
+	}
+
+	if (group_p != NULL && atomic_fetch_add(&group_p->pending, num_jobs) == 0){
+		pthread_mutex_lock(&group_p->lock);
+		group_p->done = 0;
+		pthread_mutex_unlock(&group_p->lock);
+	}
+
+	atomic_fetch_add(&thpool_p->num_jobs_pending, num_jobs);
+	jobqueue_push_batch(&thpool_p->jobqueue, first_p, last_p, num_jobs);
+}
+
+
+/* Give back a job that has run
+ *
+ * A worker keeps up to THPOOL_JOB_CACHE of them for the work it adds
+ * itself, the rest go back to the pool for the threads adding work.
+ */
+static void job_release(thpool_* thpool_p, job* job_p){
+	thread* self_p = thread_self;
+	if (self_p != NULL && self_p->thpool_p == thpool_p && self_p->num_free_jobs < THPOOL_JOB_CACHE){
+		job_p->prev = self_p->free_jobs;
+		self_p->free_jobs = job_p;
+		self_p->num_free_jobs++;
+		return;
+	}
+
+	pthread_mutex_lock(&thpool_p->jobs_lock);
+	job_p->prev = thpool_p->free_jobs;
+	thpool_p->free_jobs = job_p;
+	pthread_mutex_unlock(&thpool_p->jobs_lock);
+}
+
+
+/* Free every job the pool ever allocated */
+static void job_slabs_free(thpool_* thpool_p){
+	while (thpool_p->slabs != NULL){
+		job_slab* slab_p = thpool_p->slabs;
+		thpool_p->slabs = slab_p->next;
+		free(slab_p);
+	}
+	thpool_p->free_jobs = NULL;
+}
+
+
+/* Find a job for a thread that waits on the pool
+ *
+ * Workers of the pool look the same way they do between jobs, any other
+ * thread takes from the global queue or steals from the workers.
+ */
+static struct job* job_find(thpool_* thpool_p){
+	thread* self_p = thread_self;
+	if (self_p != NULL && self_p->thpool_p == thpool_p){
+		return thread_next_job(self_p);
+	}
+
+	job* job_p = jobqueue_pull(&thpool_p->jobqueue);
+	if (job_p != NULL){
+		return job_p;
+	}
+
+	int n;
+	int num_threads = thpool_p->num_threads;
+	int victim = num_threads > 0 ? (int)(atomic_fetch_add(&helper_victim, 1) % (unsigned int)num_threads) : 0;
+	for (n=0; n<num_threads; n++, victim = (victim + 1) % num_threads){
+		job_p = wsdeque_steal(&thpool_p->threads[victim]->deque);
+		if (job_p != NULL){
+			return job_p;
+		}
+	}
+	return NULL;
+}
+
+
+
+
+
 /* ============================ JOB QUEUE =========================== */
 
 
 /* Initialize queue */
 static int jobqueue_init(jobqueue* jobqueue_p){
 	jobqueue_p->len = 0;
+	jobqueue_p->posted = 0;
 	jobqueue_p->front = NULL;
 	jobqueue_p->rear  = NULL;
 
@@ -420,17 +1186,18 @@ static int jobqueue_init(jobqueue* jobqueue_p){
 }
 
 
-/* Clear the queue */
+/* Clear the queue (the jobs go with the pool's slabs) */
 static void jobqueue_clear(jobqueue* jobqueue_p){
 
 	while(jobqueue_p->len){
-		free(jobqueue_pull(jobqueue_p));
+		jobqueue_pull(jobqueue_p);
 	}
 
 	jobqueue_p->front = NULL;
 	jobqueue_p->rear  = NULL;
 	bsem_reset(jobqueue_p->has_jobs);
 	jobqueue_p->len = 0;
+	jobqueue_p->posted = 0;
 
 }
 
@@ -461,6 +1228,35 @@ static void jobqueue_push(jobqueue* jobqueue_p, struct job* newjob){
 }
 
 
+/* Add a list of (allocated) jobs, linked through prev, to queue
+ *
+ * Unlike jobqueue_push() nobody is woken, that is up to the caller.
+ */
+static void jobqueue_push_batch(jobqueue* jobqueue_p, struct job* first_p, struct job* last_p, int num_jobs){
+
+	pthread_mutex_lock(&jobqueue_p->rwmutex);
+	last_p->prev = NULL;
+
+	switch(jobqueue_p->len){
+
+		case 0:  /* if no jobs in queue */
+					jobqueue_p->front = first_p;
+					jobqueue_p->rear  = last_p;
+					break;
+
+		default: /* if jobs in queue */
+					jobqueue_p->rear->prev = first_p;
+					jobqueue_p->rear = last_p;
+
+	}
+	jobqueue_p->len += num_jobs;
+
+	/* Only the pool's idle workers sleep on has_jobs, wake one per job at most */
+	jobqueue_p->posted += bsem_post_many(jobqueue_p->has_jobs, num_jobs);
+	pthread_mutex_unlock(&jobqueue_p->rwmutex);
+}
+
+
 /* Get first job from queue(removes it from queue)
  * Notice: Caller MUST hold a mutex
  */
@@ -478,13 +1274,21 @@ static struct job* jobqueue_pull(jobqueue* jobqueue_p){
 					jobqueue_p->front = NULL;
 					jobqueue_p->rear  = NULL;
 					jobqueue_p->len = 0;
+					jobqueue_p->posted = 0;
 					break;
 
 		default: /* if >1 jobs in queue */
 					jobqueue_p->front = job_p->prev;
 					jobqueue_p->len--;
-					/* more than one job in queue -> post it */
-					bsem_post(jobqueue_p->has_jobs);
+					/* count this pull against the wake-ups a batch sent (a lower
+					 * bound on those still under way, whoever pulled) */
+					if (jobqueue_p->posted > 0) {
+						jobqueue_p->posted--;
+					}
+					/* more jobs in queue than threads already woken -> post it */
+					if (jobqueue_p->len > jobqueue_p->posted) {
+						bsem_post(jobqueue_p->has_jobs);
+					}
 
 	}
 
@@ -503,6 +1307,81 @@ static void jobqueue_destroy(jobqueue* jobqueue_p){
 
 
 
+/* ===================== WORK-STEALING DEQUE ======================== */
+
+
+/* Initialize deque */
+static void wsdeque_init(wsdeque* wsdeque_p){
+	atomic_init(&wsdeque_p->top, 0);
+	atomic_init(&wsdeque_p->bottom, 0);
+}
+
+
+/* Add job at the bottom (owner only)
+ *
+ * @return 0 on success, -1 if the deque is full
+ */
+static int wsdeque_push(wsdeque* wsdeque_p, struct job* newjob){
+	long b = atomic_load_explicit(&wsdeque_p->bottom, memory_order_relaxed);
+	long t = atomic_load_explicit(&wsdeque_p->top, memory_order_acquire);
+	if (b - t >= THPOOL_DEQUE_SIZE){
+		return -1;
+	}
+	atomic_store_explicit(&wsdeque_p->buffer[b & (THPOOL_DEQUE_SIZE - 1)], newjob, memory_order_relaxed);
+	atomic_store_explicit(&wsdeque_p->bottom, b + 1, memory_order_release);
+	return 0;
+}
+
+
+/* Take job from the bottom (owner only) */
+static struct job* wsdeque_pop(wsdeque* wsdeque_p){
+	long b = atomic_load_explicit(&wsdeque_p->bottom, memory_order_relaxed) - 1;
+	atomic_store_explicit(&wsdeque_p->bottom, b, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	long t = atomic_load_explicit(&wsdeque_p->top, memory_order_relaxed);
+
+	job* job_p = NULL;
+	if (t <= b){
+		job_p = atomic_load_explicit(&wsdeque_p->buffer[b & (THPOOL_DEQUE_SIZE - 1)], memory_order_relaxed);
+		if (t == b){
+			/* last job, race against thieves for it */
+			if (!atomic_compare_exchange_strong_explicit(&wsdeque_p->top, &t, t + 1,
+			                                             memory_order_seq_cst, memory_order_relaxed)){
+				job_p = NULL;
+			}
+			atomic_store_explicit(&wsdeque_p->bottom, b + 1, memory_order_relaxed);
+		}
+	}
+	else {
+		/* deque was empty */
+		atomic_store_explicit(&wsdeque_p->bottom, b + 1, memory_order_relaxed);
+	}
+	return job_p;
+}
+
+
+/* Take job from the top (any thread) */
+static struct job* wsdeque_steal(wsdeque* wsdeque_p){
+	long t = atomic_load_explicit(&wsdeque_p->top, memory_order_acquire);
+	atomic_thread_fence(memory_order_seq_cst);
+	long b = atomic_load_explicit(&wsdeque_p->bottom, memory_order_acquire);
+
+	if (t >= b){
+		return NULL;
+	}
+	job* job_p = atomic_load_explicit(&wsdeque_p->buffer[t & (THPOOL_DEQUE_SIZE - 1)], memory_order_relaxed);
+	if (!atomic_compare_exchange_strong_explicit(&wsdeque_p->top, &t, t + 1,
+	                                             memory_order_seq_cst, memory_order_relaxed)){
+		/* lost the race against the owner or another thief */
+		return NULL;
+	}
+	return job_p;
+}
+
+
+
+
+
 /* ======================== SYNCHRONISATION ========================= */
 
 
@@ -515,6 +1394,8 @@ static void bsem_init(bsem *bsem_p, int value) {
 	pthread_mutex_init(&(bsem_p->mutex), NULL);
 	pthread_cond_init(&(bsem_p->cond), NULL);
 	bsem_p->v = value;
+	bsem_p->closed = 0;
+	bsem_p->waiting = 0;
 }
 
 
@@ -527,27 +1408,56 @@ static void bsem_reset(bsem *bsem_p) {
 /* Post to at least one thread */
 static void bsem_post(bsem *bsem_p) {
 	pthread_mutex_lock(&bsem_p->mutex);
-	bsem_p->v = 1;
+	if (bsem_p->v < 1) {
+		bsem_p->v = 1;
+	}
 	pthread_cond_signal(&bsem_p->cond);
 	pthread_mutex_unlock(&bsem_p->mutex);
 }
 
 
-/* Post to all threads */
-static void bsem_post_all(bsem *bsem_p) {
+/* Post to up to num_posts threads, returns the number of posts */
+static int bsem_post_many(bsem *bsem_p, int num_posts) {
 	pthread_mutex_lock(&bsem_p->mutex);
-	bsem_p->v = 1;
-	pthread_cond_broadcast(&bsem_p->cond);
+	/* No more than the threads asleep, but a thread about to wait may already
+	 * have looked for work, so always leave at least one post behind */
+	if (num_posts > bsem_p->waiting) {
+		num_posts = bsem_p->waiting;
+	}
+	if (num_posts < 1) {
+		num_posts = 1;
+	}
+	if (bsem_p->v < num_posts) {
+		bsem_p->v = num_posts;
+	}
+	int n;
+	for (n=0; n<num_posts; n++) {
+		pthread_cond_signal(&bsem_p->cond);
+	}
 	pthread_mutex_unlock(&bsem_p->mutex);
+	return num_posts;
 }
 
 
 /* Wait on semaphore until semaphore has value 0 */
 static void bsem_wait(bsem* bsem_p) {
 	pthread_mutex_lock(&bsem_p->mutex);
-	while (bsem_p->v != 1) {
+	while (bsem_p->v < 1 && !bsem_p->closed) {
+		bsem_p->waiting++;
 		pthread_cond_wait(&bsem_p->cond, &bsem_p->mutex);
+		bsem_p->waiting--;
+	}
+	if (!bsem_p->closed) {
+		bsem_p->v--;
 	}
-	bsem_p->v = 0;
+	pthread_mutex_unlock(&bsem_p->mutex);
+}
+
+
+/* Let all current and future waits return at once */
+static void bsem_close(bsem *bsem_p) {
+	pthread_mutex_lock(&bsem_p->mutex);
+	bsem_p->closed = 1;
+	pthread_cond_broadcast(&bsem_p->cond);
 	pthread_mutex_unlock(&bsem_p->mutex);
 }
\ No newline at end of file
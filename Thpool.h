@@ -14,7 +14,23 @@ extern "C" {
 /* =================================== API ======================================= */
 
 
+#include <stddef.h>
+
+/* Largest argument thpool_add_work_inline() copies into a job */
+#define THPOOL_INLINE_ARG_SIZE 64
+
+
 typedef struct thpool_* threadpool;
+typedef struct thpool_group_* thpool_group;
+
+
+/* Settings of a threadpool made with thpool_init_config() */
+typedef struct thpool_config {
+	int num_threads;    /* number of threads to be created               */
+	int pin_threads;    /* pin each thread to a cpu, filling one NUMA
+	                       node after the other (ignored where the cpu
+	                       topology is not available)                     */
+} thpool_config;
 
 
 /**
@@ -37,6 +53,29 @@ typedef struct thpool_* threadpool;
 threadpool thpool_init(int num_threads);
 
 
+/**
+ * @brief  Initialize threadpool with the given settings
+ *
+ * Same as thpool_init(), optionally pinning the threads to cpus. Pinned
+ * threads are spread over the cpus the process may run on node by node
+ * (from /sys/devices/system/node on Linux), so a pool smaller than the
+ * machine stays on as few NUMA nodes as possible and memory first touched
+ * by a thread is allocated on its node.
+ *
+ * @example
+ *
+ *    ..
+ *    thpool_config config = { 8, 1 };
+ *    threadpool thpool = thpool_init_config(&config);
+ *    ..
+ *
+ * @param  config        settings of the threadpool
+ * @return threadpool    created threadpool on success,
+ *                       NULL on error
+ */
+threadpool thpool_init_config(const thpool_config* config);
+
+
 /**
  * @brief Add work to the job queue
  *
@@ -67,6 +106,168 @@ threadpool thpool_init(int num_threads);
 int thpool_add_work(threadpool, void (*function_p)(void*), void* arg_p);
 
 
+/**
+ * @brief Add work to the job queue with a copy of its argument
+ *
+ * Same as thpool_add_work(), except that the arg_size bytes at arg_p are
+ * copied into the job itself and function_p gets a pointer to that copy,
+ * which stays valid until function_p returns. Small argument structs can
+ * so live on the caller's stack instead of being allocated per job.
+ *
+ * @example
+ *
+ *    struct band { int start, end; };
+ *    void blur_band(void* arg){
+ *       struct band* band = (struct band*)arg;
+ *       ..
+ *    }
+ *
+ *    int main() {
+ *       ..
+ *       struct band band = { 0, 16 };
+ *       thpool_add_work_inline(thpool, blur_band, &band, sizeof(band));
+ *       ..
+ *    }
+ *
+ * @param  threadpool    threadpool to which the work will be added
+ * @param  function_p    pointer to function to add as work
+ * @param  arg_p         pointer to the argument to copy
+ * @param  arg_size      size of the argument, at most THPOOL_INLINE_ARG_SIZE
+ * @return 0 on success, -1 otherwise.
+ */
+int thpool_add_work_inline(threadpool, void (*function_p)(void*), const void* arg_p, size_t arg_size);
+
+
+/**
+ * @brief Add a batch of work to the job queue
+ *
+ * Same as calling thpool_add_work() once per argument, except that all the
+ * jobs are linked into the queue under a single lock and at most one idle
+ * thread per job is woken, so fanning out thousands of jobs is one cheap
+ * call. Either all jobs are added or none is.
+ *
+ * @example
+ *
+ *    void blur_tile(void* arg){
+ *       ..
+ *    }
+ *
+ *    int main() {
+ *       ..
+ *       void* tiles[256];
+ *       ..
+ *       thpool_add_work_batch(thpool, blur_tile, tiles, 256);
+ *       thpool_wait(thpool);
+ *       ..
+ *    }
+ *
+ * @param  threadpool    threadpool to which the work will be added
+ * @param  function_p    pointer to function to add as work
+ * @param  args_p        one argument per job
+ * @param  num_jobs      number of jobs to add
+ * @return 0 on success, -1 otherwise.
+ */
+int thpool_add_work_batch(threadpool, void (*function_p)(void*), void** args_p, int num_jobs);
+
+
+/**
+ * @brief Run a function over an index range in parallel
+ *
+ * Splits the half-open range [begin, end) into contiguous chunks and runs
+ * function_p once per chunk on the threadpool. The number of chunks is
+ * bounded by a small multiple of the number of threads and no chunk is
+ * smaller than grain (except possibly the last one), so the cost of the
+ * call does not grow with the size of the range. Returns once every chunk
+ * has finished; the calling thread runs chunks itself while it waits, so
+ * other work on the pool is not waited for.
+ *
+ * @example
+ *
+ *    void scale_rows(int start, int end, void* arg){
+ *       for (int row = start; row < end; row++) { .. }
+ *    }
+ *
+ *    int main() {
+ *       ..
+ *       thpool_parallel_for(thpool, 0, height, 16, scale_rows, (void*)img);
+ *       ..
+ *    }
+ *
+ * @param  threadpool    threadpool to run the chunks on
+ * @param  begin         first index of the range
+ * @param  end           one past the last index of the range
+ * @param  grain         minimum number of indices per chunk
+ * @param  function_p    function called as function_p(start, end, arg_p)
+ * @param  arg_p         pointer to an argument shared by all chunks
+ * @return 0 on success, -1 otherwise.
+ */
+int thpool_parallel_for(threadpool, int begin, int end, int grain,
+                        void (*function_p)(int, int, void*), void* arg_p);
+
+
+/**
+ * @brief Make a task group
+ *
+ * A task group tracks the jobs added through it so that they can be waited
+ * for on their own, without waiting for everything else running on the
+ * pool. Groups are cheap and meant to be made per batch of work.
+ *
+ * @example
+ *
+ *    ..
+ *    thpool_group group = thpool_group_init(thpool);
+ *    thpool_group_add_work(group, (void*)task, (void*)arg1);
+ *    thpool_group_add_work(group, (void*)task, (void*)arg2);
+ *    thpool_group_wait(group);              // only waits for arg1 and arg2
+ *    thpool_group_destroy(group);
+ *    ..
+ *
+ * @param  threadpool    threadpool the jobs of the group will run on
+ * @return thpool_group  created task group on success,
+ *                       NULL on error
+ */
+thpool_group thpool_group_init(threadpool);
+
+
+/**
+ * @brief Add work to the job queue as part of a task group
+ *
+ * Same as thpool_add_work(), except that the job is counted against the
+ * group until it has finished. Jobs of a group may add more work to it.
+ *
+ * @param  thpool_group  task group the work belongs to
+ * @param  function_p    pointer to function to add as work
+ * @param  arg_p         pointer to an argument
+ * @return 0 on success, -1 otherwise.
+ */
+int thpool_group_add_work(thpool_group, void (*function_p)(void*), void* arg_p);
+
+
+/**
+ * @brief Wait for all jobs of a task group to finish
+ *
+ * Instead of going to sleep straight away, the calling thread runs queued
+ * jobs of the pool (of any group) until none are left, and only then
+ * sleeps until the last job of the group has finished. It is safe to call
+ * from within a job running on the same pool.
+ *
+ * @param  thpool_group  task group to wait for
+ * @return nothing
+ */
+void thpool_group_wait(thpool_group);
+
+
+/**
+ * @brief Free a task group
+ *
+ * The group must not have unfinished jobs, call thpool_group_wait() first.
+ *
+ * @param  thpool_group  task group to free
+ * @return nothing
+ */
+void thpool_group_destroy(thpool_group);
+
+
 /**
  * @brief Wait for all queued jobs to finish
  *
@@ -98,13 +299,15 @@ void thpool_wait(threadpool);
 
 
 /**
- * @brief Pauses all threads immediately
+ * @brief Pauses all threads of the threadpool
  *
- * The threads will be paused no matter if they are idle or working.
- * The threads return to their previous states once thpool_resume
+ * Idle threads stay idle and working threads stop once their current job
+ * has finished (a running job is never interrupted), other pools keep
+ * running. The threads return to their previous states once thpool_resume
  * is called.
  *
- * While the thread is being paused, new work can be added.
+ * While the thread is being paused, new work can be added. Threads waiting
+ * on a task group still run its jobs themselves.
  *
  * @example
  *
@@ -124,6 +327,9 @@ void thpool_pause(threadpool);
 /**
  * @brief Unpauses all threads if they are paused
  *
+ * The held threads are woken straight away and pick up the work added
+ * meanwhile.
+ *
  * @example
  *    ..
  *    thpool_pause(thpool);
@@ -141,7 +347,10 @@ void thpool_resume(threadpool);
  * @brief Destroy the threadpool
  *
  * This will wait for the currently active threads to finish and then 'kill'
- * the whole threadpool to free up memory.
+ * the whole threadpool to free up memory. Idle threads are woken and joined
+ * straight away and queued jobs that have not started are dropped, call
+ * thpool_wait() first to have them run. Other pools in the process are not
+ * affected.
  *
  * @example
  * int main() {
@@ -180,6 +389,79 @@ void thpool_destroy(threadpool);
 int thpool_num_threads_working(threadpool);
 
 
+/**
+ * @brief Show the number of threads in the threadpool
+ *
+ * @example
+ * int main() {
+ *    threadpool thpool1 = thpool_init(2);
+ *    ..
+ *    printf("Threads: %d\n", thpool_num_threads(thpool1));
+ *    ..
+ *    return 0;
+ * }
+ *
+ * @param threadpool     the threadpool of interest
+ * @return integer       number of threads created for the pool
+ */
+int thpool_num_threads(threadpool);
+
+
+/**
+ * @brief Get the process-wide threadpool
+ *
+ * Returns a threadpool shared by the whole process. The pool is created
+ * lazily on the first call and is sized to the number of online CPUs, so
+ * callers that only need "some threads" do not pay for thread creation
+ * on every use. Do not call thpool_destroy() on the returned pool, use
+ * thpool_global_shutdown() instead.
+ *
+ * @example
+ *
+ *    ..
+ *    thpool_add_work(thpool_global(), (void*)task, (void*)arg);
+ *    thpool_wait(thpool_global());
+ *    ..
+ *    thpool_global_shutdown();              // once, before exiting
+ *
+ * @return threadpool    the shared threadpool on success,
+ *                       NULL on error
+ */
+threadpool thpool_global(void);
+
+
+/**
+ * @brief Set up the process-wide threadpool
+ *
+ * Settings used when thpool_global() creates the shared pool, a
+ * num_threads below 1 keeps the number of online CPUs. Has no effect once
+ * the pool exists (until thpool_global_shutdown()).
+ *
+ * @example
+ *
+ *    ..
+ *    thpool_config config = { 0, 1 };       // one pinned thread per cpu
+ *    thpool_global_config(&config);
+ *    ..
+ *
+ * @param  config        settings of the shared threadpool
+ * @return 0 on success, -1 if the shared pool already exists
+ */
+int thpool_global_config(const thpool_config* config);
+
+
+/**
+ * @brief Destroy the process-wide threadpool
+ *
+ * Waits for the shared pool to finish its work and then destroys it.
+ * Calling it when the pool has not been created is a no-op. A later call
+ * to thpool_global() creates a fresh pool.
+ *
+ * @return nothing
+ */
+void thpool_global_shutdown(void);
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,9 +1,40 @@
 #include "Utils.h"
 #include <unistd.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include "Thpool.h"
 
   #define DEFAULT_COMPRESSION_QUALITY -1
   #define FULL_COLOUR_CHANNELS 3
 
+  const struct jpeg_options default_jpeg_options = { 100, false, true, true, false };
+
+  // Runs sod's pixel conversion tasks on the global thread pool
+  struct sod_parallel_args {
+    void (*task)(void *, int);
+    void *task_data;
+  };
+
+  static void sod_parallel_chunk(int start, int end, void *args_ptr){
+    struct sod_parallel_args *args = (struct sod_parallel_args *) args_ptr;
+    for(int i = start; i < end; i++){
+      args->task(args->task_data, i);
+    }
+  }
+
+  static void sod_parallel_runner(void *user_data, int n_tasks, void (*task)(void *, int), void *task_data){
+    struct sod_parallel_args args = {task, task_data};
+    if(thpool_parallel_for(thpool_global(), 0, n_tasks, 1, sod_parallel_chunk, &args) != 0){
+      sod_parallel_chunk(0, n_tasks, &args);
+    }
+  }
+
+  static pthread_once_t sod_parallel_once = PTHREAD_ONCE_INIT;
+
+  static void install_sod_parallel_hook(void){
+    sod_set_parallel_hook(sod_parallel_runner, NULL);
+  }
+
   sod_img create_image(int width, int height){
     return sod_make_image(width, height, FULL_COLOUR_CHANNELS);   
   }
@@ -19,6 +50,7 @@
       input.data = 0;
       return input;
     }
+    pthread_once(&sod_parallel_once, install_sod_parallel_hook);
     input = sod_img_load_from_file(path, SOD_IMG_COLOR);  
     if(input.data == 0){
       printf("[!] unsupported image format (expecting jpeg, png or bmp)\n");
@@ -26,7 +58,90 @@
     return input;
   }
     
+  sod_img load_image_scaled(const char *path, int denom){
+    sod_img input;
+    if(denom != 1 && denom != 2 && denom != 4 && denom != 8){
+      printf("[!] invalid scale 1/%i (must be 1/1, 1/2, 1/4 or 1/8)\n", denom);
+      input.data = 0;
+      return input;
+    }
+    if( access(path, F_OK) == IO_ERROR ){
+      printf("[!] error reading from file %s (check it exists)\n", path);
+      input.data = 0;
+      return input;
+    }
+    pthread_once(&sod_parallel_once, install_sod_parallel_hook);
+    input = sod_img_load_from_file_scaled(path, SOD_IMG_COLOR, denom);  
+    if(input.data == 0){
+      printf("[!] unsupported image format (expecting jpeg, png or bmp)\n");
+    }
+    return input;
+  }
+
+  unsigned char *load_pixels(const char *path, int *width, int *height){
+    if( access(path, F_OK) == IO_ERROR ){
+      printf("[!] error reading from file %s (check it exists)\n", path);
+      return NULL;
+    }
+    pthread_once(&sod_parallel_once, install_sod_parallel_hook);
+    unsigned char *pixels = sod_img_load_blob_from_file(path, width, height, FULL_COLOUR_CHANNELS);
+    if(pixels == NULL){
+      printf("[!] unsupported image format (expecting jpeg, png or bmp)\n");
+    }
+    return pixels;
+  }
+    
+  int load_images_from_directory(const char *path, sod_img **images){
+    int count = 0;
+    pthread_once(&sod_parallel_once, install_sod_parallel_hook);
+    if(sod_img_set_load_from_directory(path, images, &count, 0) != SOD_OK){
+      printf("[!] error reading from directory %s (check it exists)\n", path);
+      return IO_ERROR;
+    }
+    return count;
+  }
+
+  void free_images(sod_img *images, int count){
+    sod_img_set_release(images, count);
+  }
+
+  bool is_directory(const char *path){
+    struct stat info;
+    return stat(path, &info) == 0 && S_ISDIR(info.st_mode);
+  }
+
+  // Forwards sod's bands to a pixel_band_func
+  struct pixel_band_args {
+    pixel_band_func func;
+    void *user;
+  };
+
+  static int forward_pixel_band(void *user_data, unsigned char *rows, int y, int n_rows, int width, int height){
+    struct pixel_band_args *args = (struct pixel_band_args *) user_data;
+    return args->func(args->user, rows, y, n_rows, width, height);
+  }
+
+  bool load_pixel_bands(const char *path, pixel_band_func func, void *user){
+    if( access(path, F_OK) == IO_ERROR ){
+      printf("[!] error reading from file %s (check it exists)\n", path);
+      return false;
+    }
+    pthread_once(&sod_parallel_once, install_sod_parallel_hook);
+    struct pixel_band_args args = {func, user};
+    int ret = sod_img_load_bands_from_file(path, FULL_COLOUR_CHANNELS, forward_pixel_band, &args);
+    if(ret == SOD_ABORT){
+      // func stopped early and reports its own errors
+      return false;
+    }
+    if(ret != SOD_OK){
+      printf("[!] unsupported image format (expecting jpeg, png or bmp)\n");
+      return false;
+    }
+    return true;
+  }
+
   bool save_image(sod_img img, const char *path){
+    pthread_once(&sod_parallel_once, install_sod_parallel_hook);
     int ret = sod_img_save_as_jpeg(img, path, DEFAULT_COMPRESSION_QUALITY);
     if(ret != SOD_OK){
       printf("[!] error saving file to %s\n", path);
@@ -35,6 +150,64 @@
     return true;
   }
 
+  bool save_pixels(const unsigned char *pixels, int width, int height, const char *path,
+                   const struct jpeg_options *options){
+    if(options == NULL){
+      options = &default_jpeg_options;
+    }
+    pthread_once(&sod_parallel_once, install_sod_parallel_hook);
+    int flags = (options->chroma_subsampling ? SOD_JPEG_SUBSAMPLE_420 : 0) |
+                (options->buffered_output ? SOD_JPEG_BUFFERED_OUTPUT : 0) |
+                (options->parallel_encode ? SOD_JPEG_PARALLEL : 0);
+    int ret = sod_img_blob_save_as_jpeg_ext(path, pixels, width, height, FULL_COLOUR_CHANNELS, 
+                                            options->quality, flags);
+    if(ret != SOD_OK){
+      printf("[!] error saving file to %s\n", path);
+      return false;
+    }
+    return true;
+  }
+
+  sod_jpeg_stream *begin_pixel_stream(const char *path, int width, int height,
+                                      const struct jpeg_options *options){
+    if(options == NULL){
+      options = &default_jpeg_options;
+    }
+    int flags = (options->chroma_subsampling ? SOD_JPEG_SUBSAMPLE_420 : 0) |
+                (options->buffered_output ? SOD_JPEG_BUFFERED_OUTPUT : 0);
+    sod_jpeg_stream *stream = sod_img_jpeg_stream_begin(path, width, height, FULL_COLOUR_CHANNELS,
+                                                        options->quality, flags);
+    if(stream == NULL){
+      printf("[!] error saving file to %s\n", path);
+    }
+    return stream;
+  }
+
+  bool write_pixel_rows(sod_jpeg_stream *stream, const unsigned char *rows, int n_rows){
+    return sod_img_jpeg_stream_write(stream, rows, n_rows) == SOD_OK;
+  }
+
+  bool end_pixel_stream(sod_jpeg_stream *stream, const char *path){
+    if(sod_img_jpeg_stream_end(stream) != SOD_OK){
+      printf("[!] error saving file to %s\n", path);
+      return false;
+    }
+    return true;
+  }
+
+  bool transform_jpeg(const char *src, const char *dst, enum jpeg_transform transform){
+    static const int sod_transforms[] = { 
+      SOD_JPEG_ROTATE_90, SOD_JPEG_ROTATE_180, SOD_JPEG_ROTATE_270, SOD_JPEG_FLIP_H, SOD_JPEG_FLIP_V 
+    };
+    // failures are left for the pixel path to report
+    return sod_img_jpeg_transform(src, dst, sod_transforms[transform]) == SOD_OK;
+  }
+
+  unsigned char *image_to_pixels(sod_img img){
+    pthread_once(&sod_parallel_once, install_sod_parallel_hook);
+    return sod_image_to_blob(img);
+  }
+
   sod_img copy_image(sod_img img){
     return sod_copy_image(img);   
   }
@@ -9,6 +9,34 @@
   #define IO_ERROR -1
   #define MAX_PIXEL_INTENSITY 255.0
 
+  // JPEG encoder settings used when saving pixels
+  struct jpeg_options {
+    // 1 (smallest file) to 100 (best looking)
+    int quality;
+    // store colour at half resolution (4:2:0) rather than full resolution (4:4:4)
+    bool chroma_subsampling;
+    // buffer the entropy coded output (same bytes, fewer writes)
+    bool buffered_output;
+    // encode strips of the picture on the thread pool (separated by restart markers)
+    bool parallel_encode;
+    // rotate/flip JPEG input by moving its DCT blocks when possible (keeps the
+    // source's quantisation, so the other settings do not apply)
+    bool lossless_transform;
+  };
+
+  // settings used when no options are given: quality 100, 4:4:4, buffered output,
+  // parallel encode, no lossless transforms
+  extern const struct jpeg_options default_jpeg_options;
+
+  // rotations (clockwise) and flips that transform_jpeg can apply
+  enum jpeg_transform {
+    JPEG_ROTATE_90,
+    JPEG_ROTATE_180,
+    JPEG_ROTATE_270,
+    JPEG_FLIP_H,
+    JPEG_FLIP_V
+  };
+
   // Create a new instance of a sod image of the specified width 
   // and height, using the full RGB colour model.
   sod_img create_image(int width, int height);
@@ -18,10 +46,70 @@
   
   // Create a sod image from the the image file at the specified location.
   sod_img load_image(const char *path);  
+
+  // Create a sod image at 1/denom (1, 2, 4 or 8) of the size of the image file
+  // at the specified location, e.g. for thumbnails. JPEGs are decoded straight
+  // to the smaller size, so decoding costs up to denom^2 less time and memory.
+  sod_img load_image_scaled(const char *path, int denom);
   
+  // Load the image file at the specified location straight into interleaved 
+  // 8-bit RGB pixels (the result must be released with free)
+  unsigned char *load_pixels(const char *path, int *width, int *height);
+
+  // Create a sod image from every image file (jpeg, png, bmp, ...) in the directory
+  // at the specified location, in file name order. Files are decoded several at a
+  // time on the thread pool, without changing the working directory. Returns the
+  // number of images in *images (released with free_images), or IO_ERROR.
+  int load_images_from_directory(const char *path, sod_img **images);
+
+  // Free the images provided by load_images_from_directory
+  void free_images(sod_img *images, int count);
+
+  // Check whether the specified location is a directory
+  bool is_directory(const char *path);
+
+  // Receives consecutive bands of interleaved 8-bit RGB rows [y, y + n_rows), top to
+  // bottom, of a width x height image; the rows may be modified in place (they are only
+  // valid during the call). Return false to stop loading.
+  typedef bool (*pixel_band_func)(void *user, unsigned char *rows, int y, int n_rows,
+                                  int width, int height);
+
+  // Load the image file at the specified location a band of rows at a time. Baseline
+  // JPEGs are decoded one MCU row at a time, so only a few rows are ever in memory;
+  // other images are decoded whole first. Returns false on error or when func stopped.
+  bool load_pixel_bands(const char *path, pixel_band_func func, void *user);
+
   // Saves the given image in the given destination.
   bool save_image(sod_img img, const char *path);
     
+  // Saves interleaved 8-bit RGB pixels of the given size in the given destination
+  // (NULL options selects default_jpeg_options)
+  bool save_pixels(const unsigned char *pixels, int width, int height, const char *path,
+                   const struct jpeg_options *options);
+
+  // Starts saving interleaved 8-bit RGB pixels of the given size to the given destination
+  // as rows become available (NULL options selects default_jpeg_options, parallel_encode 
+  // does not apply). Returns NULL on error.
+  sod_jpeg_stream *begin_pixel_stream(const char *path, int width, int height,
+                                      const struct jpeg_options *options);
+
+  // Encodes the next n_rows rows of a stream started with begin_pixel_stream
+  bool write_pixel_rows(sod_jpeg_stream *stream, const unsigned char *rows, int n_rows);
+
+  // Completes (and releases) a stream started with begin_pixel_stream, false when
+  // saving failed or fewer rows than the height were written
+  bool end_pixel_stream(sod_jpeg_stream *stream, const char *path);
+
+  // Rotates/flips the JPEG file at src into dst without decoding it: the DCT
+  // coefficient blocks are rearranged, so no pixel is re-quantised. Returns false
+  // (and writes nothing) when src is not a YCbCr or grayscale JPEG, or when a 
+  // mirrored side is not a whole number of MCUs; use the pixel path instead.
+  bool transform_jpeg(const char *src, const char *dst, enum jpeg_transform transform);
+
+  // Converts the image provided as argument to interleaved 8-bit RGB pixels
+  // (the result must be released with free)
+  unsigned char *image_to_pixels(sod_img img);
+    
   // Clones the image provided as argument
   sod_img copy_image(sod_img img);
   
@@ -1,6 +1,7 @@
 #!/usr/bin/env ruby
 
 require 'json'
+require 'fileutils'
 
 # test result array (for JSON output)
 @testscores = []
@@ -9,7 +10,9 @@ require 'json'
 
 # SUPPORT FUNCTIONS:
 
-def run_test(test_name, cmd_line, expected_image, error_as_fail=true)
+# expected_output: text the picture library must print (e.g. which path it took)
+# max_mean_diff: compare the output picture on average rather than per pixel
+def run_test(test_name, cmd_line, expected_image, error_as_fail=true, expected_output=nil, max_mean_diff=nil)
 
   # run the picture library on the supplied command line input
   puts "> running: #{test_name}"
@@ -35,6 +38,14 @@ def run_test(test_name, cmd_line, expected_image, error_as_fail=true)
     return    
   end
   
+  # check the library took the expected path (if specified)
+  if(expected_output && !output.include?(expected_output)) then
+    puts "  - picture library output did not contain: #{expected_output.inspect}"
+    @testscores << {"score": 0, "name": "#{test_name}", "possible": 1}
+    puts ""
+    return
+  end
+  
   puts ""
   
   # check final image same as expected image (if specified)
@@ -42,7 +53,7 @@ def run_test(test_name, cmd_line, expected_image, error_as_fail=true)
       
     puts "check final state of output image:"
     actual_image = cmd_line.split(" ")[1]
-    system %Q(./picture_compare #{actual_image} test_images/#{expected_image} 2>&1)
+    system %Q(./picture_compare #{actual_image} test_images/#{expected_image} #{max_mean_diff} 2>&1)
     test_success = $?.exitstatus == 0
     
     # report test failure case
@@ -66,6 +77,102 @@ def run_test(test_name, cmd_line, expected_image, error_as_fail=true)
   puts ""
 end
 
+# run the picture library on two command lines and check both write the same file
+# (e.g. a faster path against the plain pixel path), byte for byte
+def run_match_test(test_name, cmd_line, reference_cmd_line, expected_output=nil, input_restarts=false)
+
+  puts "> running: #{test_name}"
+  puts "--------------------------------------"
+  
+  # check the input holds restart markers (a DRI segment) when the test relies on them
+  input_image = cmd_line.split(" ")[0]
+  if(input_restarts && !(File.exist?(input_image) && File.binread(input_image).include?("\xFF\xDD".b))) then
+    puts "  - input picture #{input_image} has no restart markers!"
+    @testscores << {"score": 0, "name": "#{test_name}", "possible": 1}
+    puts ""
+    return
+  end
+  
+  outputs = [cmd_line, reference_cmd_line].map do |line|
+    puts "run picture library on command line: #{line}"
+    output = %x(./picture_lib #{line})
+    puts output
+    if($?.exitstatus != 0) then
+      puts "  - picture library reported non-zero exit code on valid input!"
+      @testscores << {"score": 0, "name": "#{test_name}", "possible": 1}
+      puts ""
+      return
+    end
+    output
+  end
+  
+  # check the library took the expected path (if specified)
+  if(expected_output && !outputs[0].include?(expected_output)) then
+    puts "  - picture library output did not contain: #{expected_output.inspect}"
+    @testscores << {"score": 0, "name": "#{test_name}", "possible": 1}
+    puts ""
+    return
+  end
+  
+  actual_image = cmd_line.split(" ")[1]
+  reference_image = reference_cmd_line.split(" ")[1]
+  if(!FileUtils.compare_file(actual_image, reference_image)) then
+    puts "  - #{actual_image} is not the same file as #{reference_image}!"
+    @testscores << {"score": 0, "name": "#{test_name}", "possible": 1}
+    puts ""
+    return
+  end
+  
+  puts ("  + output picture matches #{reference_image}")
+  @testscores << {"score": 1, "name": "#{test_name}", "possible": 1}
+  puts ""
+end
+
+# run the picture library on a directory of pictures and check the n-th output
+# picture (in file name order) matches the n-th expected image
+def run_directory_test(test_name, cmd_line, expected_images, expected_output=nil)
+
+  puts "> running: #{test_name}"
+  puts "--------------------------------------"
+  puts "run picture library on command line: #{cmd_line}"
+  input_dir, output_dir = cmd_line.split(" ")[0..1]
+  FileUtils.rm_rf(output_dir)
+  output = %x(./picture_lib #{cmd_line})
+  test_success = $?.exitstatus == 0
+  puts output
+  
+  failure = nil
+  if(!test_success) then
+    failure = "picture library reported non-zero exit code on valid input!"
+  elsif(expected_output && !output.include?(expected_output)) then
+    failure = "picture library output did not contain: #{expected_output.inspect}"
+  elsif(File.exist?(File.join(input_dir, output_dir))) then
+    # the output directory is relative to where the library was started
+    failure = "output written inside #{input_dir} (working directory changed)!"
+  else
+    puts "check final state of output images:"
+    expected_images.each_with_index do |image, index|
+      system %Q(./picture_compare #{output_dir}/#{index}.jpg test_images/#{image} 2>&1)
+      if($?.exitstatus != 0) then
+        failure = "output picture #{index} did not match #{image}!"
+        break
+      end
+    end
+  end
+  FileUtils.rm_rf(output_dir)
+  
+  if(failure) then
+    puts "  - #{failure}"
+    @testscores << {"score": 0, "name": "#{test_name}", "possible": 1}
+    puts ""
+    return
+  end
+  
+  puts ("  + output pictures match expected")
+  @testscores << {"score": 1, "name": "#{test_name}", "possible": 1}
+  puts ""
+end
+
 #####################################################################
 
 # MAIN PROGRAM START:
@@ -111,6 +218,64 @@ else
     run_test("repeated blur test #{blur_cnt}", "par-need_glasses#{blur_cnt-1}.jpg par-need_glasses#{blur_cnt}.jpg parallel-blur", "need_glasses#{blur_cnt}.jpeg")  
   end
   
+  run_test("box blur test 1", "test_images/test.jpg box-test_blur.jpg box-blur 1", "test_blur.jpeg")
+  run_test("box blur test 2", "test_images/dip.jpg box-blip.jpg box-blur 1", "blip.jpeg")
+  
+  run_test("brightness test", "test_images/test.jpg test_brightness.jpg brightness 40", "test_brightness.jpeg")
+  run_test("contrast test", "test_images/test.jpg test_contrast.jpg contrast 150", "test_contrast.jpeg")
+  run_test("point chain test", "test_images/test.jpg test_invert_grayscale.jpg invert+grayscale", "test_invert_grayscale.jpeg")
+  
+  run_test("scaled decode test 1/2", "test_images/test.jpg test_inverted_scale_2.jpg invert --scale 2", "test_inverted_scale_2.jpeg")
+  run_test("scaled decode test 1/4", "test_images/test.jpg test_inverted_scale_4.jpg invert --scale 4", "test_inverted_scale_4.jpeg")
+  run_test("scaled decode test 1/8", "test_images/test.jpg test_inverted_scale_8.jpg invert --scale 8", "test_inverted_scale_8.jpeg")
+  
+  # buffering the encoder's output must not change a single byte of it
+  run_match_test("buffered output test", "test_images/test.jpg bo-test_blur.jpg blur --buffered-output",
+                 "test_images/test.jpg ubo-test_blur.jpg blur --no-buffered-output", "buffered output")
+  
+  # streaming encodes serially, so it has to write exactly what the serial pixel path does
+  run_match_test("streamed invert test", "test_images/test.jpg st-test_inverted.jpg invert --stream",
+                 "test_images/test.jpg px-test_inverted.jpg invert --no-parallel-encode", "calling streamed invert")
+  run_match_test("streamed grayscale test", "test_images/test.jpg st-test_grayscale.jpg grayscale --stream",
+                 "test_images/test.jpg px-test_grayscale.jpg grayscale --no-parallel-encode", "calling streamed grayscale")
+  run_match_test("streamed flip H test 1", "test_images/test.jpg st-test_flip_H.jpg flip H --stream",
+                 "test_images/test.jpg px-test_flip_H.jpg flip H --no-parallel-encode", "calling streamed flip (H)")
+  run_match_test("streamed flip H test 2", "test_images/keep_calm.jpg st-keep_calm_H.jpg flip H --stream",
+                 "test_images/keep_calm.jpg px-keep_calm_H.jpg flip H --no-parallel-encode", "calling streamed flip (H)")
+  run_match_test("streamed blur test", "test_images/test.jpg st-test_blur.jpg blur --stream",
+                 "test_images/test.jpg px-test_blur.jpg blur --no-parallel-encode", "calling streamed blur")
+  
+  # a parallel encode separates its strips with restart markers, which the streamed decode has to follow
+  run_test("restart marker input test", "test_images/test.jpg rst-test_rotate_180.jpg rotate 180 --parallel-encode", "test_rotate_180.jpeg")
+  run_match_test("streamed restart marker test 1", "rst-test_rotate_180.jpg st-rst-test_inverted.jpg invert --stream",
+                 "rst-test_rotate_180.jpg px-rst-test_inverted.jpg invert --no-parallel-encode", "calling streamed invert", true)
+  run_match_test("streamed restart marker test 2", "rst-test_rotate_180.jpg st-rst-test_blur.jpg blur --stream",
+                 "rst-test_rotate_180.jpg px-rst-test_blur.jpg blur --no-parallel-encode", "calling streamed blur", true)
+  
+  # dir_test holds a_keep_calm.jpg, b_test.jpg and a file that is not a picture
+  run_directory_test("directory test", "test_images/dir_test dir-out flip H", ["keep_calm_H.jpeg", "test_flip_H.jpeg"],
+                     "loaded 2 pictures from test_images/dir_test")
+  
+  # lossless transforms keep the input DCT coefficients, so they only match the re-encoded pixel path on average
+  lossless_done = "\n-- picture processing complete --"
+  run_test("lossless rotate 90 test", "test_images/test.jpg ll-test_rotate_90.jpg rotate 90 --lossless", "test_rotate_90.jpeg",
+           true, "calling lossless rotate (90)" + lossless_done, 0.5)
+  run_test("lossless rotate 180 test", "test_images/test.jpg ll-test_rotate_180.jpg rotate 180 --lossless", "test_rotate_180.jpeg",
+           true, "calling lossless rotate (180)" + lossless_done, 0.5)
+  run_test("lossless rotate 270 test", "test_images/test.jpg ll-test_rotate_270.jpg rotate 270 --lossless", "test_rotate_270.jpeg",
+           true, "calling lossless rotate (270)" + lossless_done, 0.5)
+  run_test("lossless flip H test", "test_images/test.jpg ll-test_flip_H.jpg flip H --lossless", "test_flip_H.jpeg",
+           true, "calling lossless flip (H)" + lossless_done, 0.5)
+  run_test("lossless flip V test", "test_images/test.jpg ll-test_flip_V.jpg flip V --lossless", "test_flip_V.jpeg",
+           true, "calling lossless flip (V)" + lossless_done, 0.5)
+  
+  # keep_calm.jpg ends in a partial MCU on both axes, so mirroring it falls back to the pixel path
+  lossless_refused = "lossless transform not possible, using the pixel path"
+  run_test("lossless fallback test 1", "test_images/keep_calm.jpg ll-keep_calm_H.jpg flip H --lossless", "keep_calm_H.jpeg",
+           true, lossless_refused)
+  run_test("lossless fallback test 2", "test_images/keep_calm.jpg ll-keep_calm_V.jpg flip V --lossless", "keep_calm_V.jpeg",
+           true, lossless_refused)
+  
   puts "----------------------------------------"
   puts "           IO ERROR Test Cases          " 
   puts "----------------------------------------"
@@ -129,6 +294,15 @@ else
   run_test("rotate arg error test 3", "test_images/test.jpg output.jpg rotate 360", nil, false)
   
   run_test("flip arg error test", "test_images/test.jpg output.jpg flip O", nil, false)
+  run_test("point chain error test 1", "test_images/test.jpg output.jpg invert+blur", nil, false)
+  run_test("point chain error test 2", "test_images/test.jpg output.jpg invert+greyscale", nil, false)
+  run_test("scale arg error test 1", "test_images/test.jpg output.jpg invert --scale 3", nil, false)
+  run_test("scale arg error test 2", "test_images/test.jpg output.jpg invert --scale 0", nil, false)
+  run_test("no such directory test", "test_images/no_such_dir/ dir-out invert", nil, false)
+  run_test("scaled directory error test", "test_images/dir_test dir-out invert --scale 2", nil, false)
+  run_test("unknown option test", "test_images/test.jpg output.jpg invert --fast-huffman", nil, false)
+  run_test("extra argument test", "test_images/test.jpg output.jpg rotate 90 180", nil, false)
+  run_test("box blur arg error test", "test_images/test.jpg output.jpg box-blur 0", nil, false)
   
   # clean up the files generated by the tests
   system %Q(make clean)
@@ -61,6 +61,9 @@
 #include <math.h>
 #include <string.h>
 #include <limits.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif /* __SSE2__ */
 /* Local includes */
 #include "sod.h"
 /* Forward declaration */
@@ -11360,20 +11363,209 @@ void sod_normalize_image(sod_img p)
 	}
 }
 /*
+* Optional parallel runner used by the pixel conversion kernels below.
+* Without one installed, every task is run in turn on the calling thread.
+*/
+static ProcSodParallel xSodParallel = 0;
+static void *pSodParallelData = 0;
+/*
+* CAPIREF: Refer to the official documentation at https://sod.pixlab.io/api.html for the expected parameters this interface takes.
+*/
+void sod_set_parallel_hook(ProcSodParallel xParallel, void *pUserData)
+{
+	/* Not synchronized: install the hook before any image is loaded or saved. */
+	xSodParallel = xParallel;
+	pSodParallelData = pUserData;
+}
+static void SodParallelRun(int nTasks, void(*xTask)(void *, int), void *pTaskData)
+{
+	int i;
+	if (xSodParallel && nTasks > 1) {
+		xSodParallel(pSodParallelData, nTasks, xTask, pTaskData);
+		return;
+	}
+	for (i = 0; i < nTasks; ++i) {
+		xTask(pTaskData, i);
+	}
+}
+/*
+* u8 interleaved <-> float planar conversion kernels.
+*
+* The arithmetic must stay bit-identical to the historical scalar loops:
+*  load: (float)v / 255. (which rounds exactly like a single precision division by 255.0f).
+*  save: (unsigned char)(255 * f) (single precision product, truncated then narrowed to 8 bits).
+* Images are cut into horizontal bands of about SOD_CONV_BAND_PIXELS pixels which are
+* handed to the parallel hook. Within a band, each channel of a row is (de)interleaved
+* through a small scratch row so that the arithmetic runs on contiguous data.
+*/
+#define SOD_CONV_BAND_PIXELS (64*1024)
+typedef struct SodConvJob SodConvJob;
+struct SodConvJob {
+	const unsigned char *zBlob; /* Interleaved 8-bit input (load) */
+	unsigned char *zOut;        /* Interleaved 8-bit output (save) */
+	const float *pIn;           /* Planar float input (save) */
+	float *pOut;                /* Planar float output (load) */
+	int w, h, c;
+	int nBandRows;              /* Rows per band */
+};
+static void SodU8ToFloatRow(const unsigned char *zIn, float *pOut, int n)
+{
+	int i = 0;
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 scale = _mm_set1_ps(255.0f);
+	for (; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)&zIn[i]);
+		__m128i lo = _mm_unpacklo_epi8(v, zero);
+		__m128i hi = _mm_unpackhi_epi8(v, zero);
+		_mm_storeu_ps(&pOut[i], _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), scale));
+		_mm_storeu_ps(&pOut[i + 4], _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), scale));
+		_mm_storeu_ps(&pOut[i + 8], _mm_div_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), scale));
+		_mm_storeu_ps(&pOut[i + 12], _mm_div_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), scale));
+	}
+#endif /* __SSE2__ */
+	for (; i < n; ++i) {
+		pOut[i] = (float)zIn[i] / 255.;
+	}
+}
+static void SodFloatToU8Row(const float *pIn, unsigned char *zOut, int n)
+{
+	int i = 0;
+#if defined(__SSE2__)
+	const __m128 scale = _mm_set1_ps(255.0f);
+	const __m128i low_byte = _mm_set1_epi32(0xFF);
+	for (; i + 16 <= n; i += 16) {
+		/* Truncate to int32 then keep the low byte, exactly like the scalar cast does */
+		__m128i a = _mm_and_si128(_mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(&pIn[i]), scale)), low_byte);
+		__m128i b = _mm_and_si128(_mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(&pIn[i + 4]), scale)), low_byte);
+		__m128i c = _mm_and_si128(_mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(&pIn[i + 8]), scale)), low_byte);
+		__m128i d = _mm_and_si128(_mm_cvttps_epi32(_mm_mul_ps(_mm_loadu_ps(&pIn[i + 12]), scale)), low_byte);
+		_mm_storeu_si128((__m128i *)&zOut[i], _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+	}
+#endif /* __SSE2__ */
+	for (; i < n; ++i) {
+		zOut[i] = (unsigned char)(255 * pIn[i]);
+	}
+}
+static void SodBlobToPlanarBand(void *pTaskData, int iBand)
+{
+	SodConvJob *pJob = (SodConvJob *)pTaskData;
+	int w = pJob->w, h = pJob->h, c = pJob->c;
+	int y_start = iBand * pJob->nBandRows;
+	int y_end = y_start + pJob->nBandRows;
+	unsigned char *zRow = 0;
+	int i, j, k;
+	if (y_end > h) y_end = h;
+	if (c > 1) {
+		zRow = malloc((size_t)w);
+	}
+	for (j = y_start; j < y_end; ++j) {
+		const unsigned char *zSrc = &pJob->zBlob[(size_t)c * w * j];
+		for (k = 0; k < c; ++k) {
+			float *pDst = &pJob->pOut[(size_t)w * h * k + (size_t)w * j];
+			if (c == 1) {
+				SodU8ToFloatRow(zSrc, pDst, w);
+			}
+			else if (zRow) {
+				for (i = 0; i < w; ++i) {
+					zRow[i] = zSrc[c * i + k];
+				}
+				SodU8ToFloatRow(zRow, pDst, w);
+			}
+			else {
+				for (i = 0; i < w; ++i) {
+					pDst[i] = (float)zSrc[c * i + k] / 255.;
+				}
+			}
+		}
+	}
+	free(zRow);
+}
+static void SodPlanarToBlobBand(void *pTaskData, int iBand)
+{
+	SodConvJob *pJob = (SodConvJob *)pTaskData;
+	int w = pJob->w, h = pJob->h, c = pJob->c;
+	int y_start = iBand * pJob->nBandRows;
+	int y_end = y_start + pJob->nBandRows;
+	unsigned char *zRow = 0;
+	int i, j, k;
+	if (y_end > h) y_end = h;
+	if (c > 1) {
+		zRow = malloc((size_t)w);
+	}
+	for (j = y_start; j < y_end; ++j) {
+		unsigned char *zDst = &pJob->zOut[(size_t)c * w * j];
+		for (k = 0; k < c; ++k) {
+			const float *pSrc = &pJob->pIn[(size_t)w * h * k + (size_t)w * j];
+			if (c == 1) {
+				SodFloatToU8Row(pSrc, zDst, w);
+			}
+			else if (zRow) {
+				SodFloatToU8Row(pSrc, zRow, w);
+				for (i = 0; i < w; ++i) {
+					zDst[c * i + k] = zRow[i];
+				}
+			}
+			else {
+				for (i = 0; i < w; ++i) {
+					zDst[c * i + k] = (unsigned char)(255 * pSrc[i]);
+				}
+			}
+		}
+	}
+	free(zRow);
+}
+static int SodConvBands(SodConvJob *pJob)
+{
+	int nBandRows = SOD_CONV_BAND_PIXELS / (pJob->w > 0 ? pJob->w : 1);
+	if (nBandRows < 1) nBandRows = 1;
+	pJob->nBandRows = nBandRows;
+	return (pJob->h + nBandRows - 1) / nBandRows;
+}
+/*
+* CAPIREF: Refer to the official documentation at https://sod.pixlab.io/api.html for the expected parameters this interface takes.
+*/
+void sod_img_blob_to_planar(const unsigned char *zBlob, float *pOut, int width, int height, int nChannels)
+{
+	SodConvJob sJob;
+	if (!zBlob || !pOut || width < 1 || height < 1 || nChannels < 1) {
+		return;
+	}
+	memset(&sJob, 0, sizeof(SodConvJob));
+	sJob.zBlob = zBlob;
+	sJob.pOut = pOut;
+	sJob.w = width;
+	sJob.h = height;
+	sJob.c = nChannels;
+	SodParallelRun(SodConvBands(&sJob), SodBlobToPlanarBand, &sJob);
+}
+/*
+* CAPIREF: Refer to the official documentation at https://sod.pixlab.io/api.html for the expected parameters this interface takes.
+*/
+void sod_img_planar_to_blob(const float *pIn, unsigned char *zBlob, int width, int height, int nChannels)
+{
+	SodConvJob sJob;
+	if (!pIn || !zBlob || width < 1 || height < 1 || nChannels < 1) {
+		return;
+	}
+	memset(&sJob, 0, sizeof(SodConvJob));
+	sJob.pIn = pIn;
+	sJob.zOut = zBlob;
+	sJob.w = width;
+	sJob.h = height;
+	sJob.c = nChannels;
+	SodParallelRun(SodConvBands(&sJob), SodPlanarToBlobBand, &sJob);
+}
+/*
 * CAPIREF: Refer to the official documentation at https://sod.pixlab.io/api.html for the expected parameters this interface takes.
 */
 unsigned char * sod_image_to_blob(sod_img im)
 {
 	unsigned char *data = 0;
-	int i, k;
 	if (im.data) {
-		data = calloc(im.w*im.h*im.c, sizeof(unsigned char));
+		data = malloc((size_t)im.w*im.h*im.c);
 		if (data) {
-			for (k = 0; k < im.c; ++k) {
-				for (i = 0; i < im.w*im.h; ++i) {
-					data[i*im.c + k] = (unsigned char)(255 * im.data[i + k * im.w*im.h]);
-				}
-			}
+			sod_img_planar_to_blob(im.data, data, im.w, im.h, im.c);
 		}
 	}
 	return data;
@@ -13536,6 +13728,8 @@ void sod_realnet_destroy(sod_realnet * pNet)
 #pragma warning(disable:4204)
 #endif /* _MSC_VER */
 #define STB_IMAGE_IMPLEMENTATION
+/* JPEG restart segments and colour conversion strips go through the installed parallel hook */
+#define STBI_PARALLEL(n,task,data) SodParallelRun(n, task, data)
 #include "sod_img_reader.h"
 /*
 * CAPIREF: Refer to the official documentation at https://sod.pixlab.io/api.html for the expected parameters this interface takes.
@@ -13543,7 +13737,6 @@ void sod_realnet_destroy(sod_realnet * pNet)
 sod_img sod_img_load_from_mem(const unsigned char * zBuf, int buf_len, int nChannels)
 {
 	int w, h, c;
-	int i, j, k;
 	unsigned char *data = stbi_load_from_memory(zBuf, buf_len, &w, &h, &c, nChannels);
 	if (!data) {
 		return sod_make_empty_image(0, 0, 0);
@@ -13551,15 +13744,7 @@ sod_img sod_img_load_from_mem(const unsigned char * zBuf, int buf_len, int nChan
 	if (nChannels) c = nChannels;
 	sod_img im = sod_make_image(w, h, c);
 	if (im.data) {
-		for (k = 0; k < c; ++k) {
-			for (j = 0; j < h; ++j) {
-				for (i = 0; i < w; ++i) {
-					int dst_index = i + w * j + w * h*k;
-					int src_index = k + c * i + c * w*j;
-					im.data[dst_index] = (float)data[src_index] / 255.;
-				}
-			}
-		}
+		sod_img_blob_to_planar(data, im.data, w, h, c);
 	}
 	free(data);
 	return im;
@@ -13574,7 +13759,6 @@ sod_img sod_img_load_from_file(const char *zFile, int nChannels)
 	void *pMap = 0;
 	size_t sz = 0; /* gcc warn */
 	int w, h, c;
-	int i, j, k;
 	if (SOD_OK != pVfs->xMmap(zFile, &pMap, &sz)) {
 		data = stbi_load(zFile, &w, &h, &c, nChannels);
 	}
@@ -13587,15 +13771,7 @@ sod_img sod_img_load_from_file(const char *zFile, int nChannels)
 	if (nChannels) c = nChannels;
 	sod_img im = sod_make_image(w, h, c);
 	if (im.data) {
-		for (k = 0; k < c; ++k) {
-			for (j = 0; j < h; ++j) {
-				for (i = 0; i < w; ++i) {
-					int dst_index = i + w * j + w * h*k;
-					int src_index = k + c * i + c * w*j;
-					im.data[dst_index] = (float)data[src_index] / 255.;
-				}
-			}
-		}
+		sod_img_blob_to_planar(data, im.data, w, h, c);
 	}
 	free(data);
 	if (pMap) {
@@ -13604,6 +13780,104 @@ sod_img sod_img_load_from_file(const char *zFile, int nChannels)
 	return im;
 }
 /*
+* CAPIREF: Refer to the official documentation at https://sod.pixlab.io/api.html for the expected parameters this interface takes.
+*/
+sod_img sod_img_load_from_file_scaled(const char *zFile, int nChannels, int iDenom)
+{
+	const sod_vfs *pVfs = sodExportBuiltinVfs();
+	unsigned char *data;
+	void *pMap = 0;
+	size_t sz = 0; /* gcc warn */
+	int w, h, c;
+	/* Same as sod_img_load_from_file() at 1/iDenom (1, 2, 4 or 8) of the size. JPEG input
+	 * is decoded straight to the reduced size (smaller idct, smaller buffers).
+	 */
+	if (SOD_OK != pVfs->xMmap(zFile, &pMap, &sz)) {
+		data = stbi_load_scaled(zFile, &w, &h, &c, nChannels, iDenom);
+	}
+	else {
+		data = stbi_load_from_memory_scaled((const unsigned char *)pMap, (int)sz, &w, &h, &c, nChannels, iDenom);
+		pVfs->xUnmap(pMap, sz);
+	}
+	if (!data) {
+		return sod_make_empty_image(0, 0, 0);
+	}
+	if (nChannels) c = nChannels;
+	sod_img im = sod_make_image(w, h, c);
+	if (im.data) {
+		sod_img_blob_to_planar(data, im.data, w, h, c);
+	}
+	free(data);
+	return im;
+}
+/*
+* Forward the decoder's bands to the caller, remembering whether it asked to stop.
+*/
+typedef struct SodBandConsumer SodBandConsumer;
+struct SodBandConsumer
+{
+	ProcSodImgBand xBand;
+	void *pUserData;
+	int bAborted;
+};
+static int SodBandForward(void *pUser, unsigned char *zRows, int iFirstRow, int nRows, int width, int height)
+{
+	SodBandConsumer *pConsumer = (SodBandConsumer *)pUser;
+	if (!pConsumer->xBand(pConsumer->pUserData, zRows, iFirstRow, nRows, width, height)) {
+		pConsumer->bAborted = 1;
+		return 0;
+	}
+	return 1;
+}
+/*
+* CAPIREF: Refer to the official documentation at https://sod.pixlab.io/api.html for the expected parameters this interface takes.
+*/
+int sod_img_load_bands_from_file(const char *zFile, int nChannels, ProcSodImgBand xBand, void *pUserData)
+{
+	const sod_vfs *pVfs = sodExportBuiltinVfs();
+	SodBandConsumer sConsumer;
+	void *pMap = 0;
+	size_t sz = 0; /* gcc warn */
+	int rc;
+	/* Decode the image a band of rows at a time, in interleaved 8-bit form: baseline JPEGs
+	 * never hold more than two MCU rows of decoded data, other formats are decoded whole.
+	 */
+	if (SOD_OK != pVfs->xMmap(zFile, &pMap, &sz)) {
+		return SOD_IOERR;
+	}
+	sConsumer.xBand = xBand;
+	sConsumer.pUserData = pUserData;
+	sConsumer.bAborted = 0;
+	rc = stbi_load_bands_from_memory((const unsigned char *)pMap, (int)sz, nChannels, SodBandForward, &sConsumer);
+	pVfs->xUnmap(pMap, sz);
+	if (sConsumer.bAborted) {
+		return SOD_ABORT;
+	}
+	return rc ? SOD_OK : SOD_IOERR;
+}
+/*
+* CAPIREF: Refer to the official documentation at https://sod.pixlab.io/api.html for the expected parameters this interface takes.
+*/
+unsigned char * sod_img_load_blob_from_file(const char *zFile, int *pWidth, int *pHeight, int nChannels)
+{
+	const sod_vfs *pVfs = sodExportBuiltinVfs();
+	unsigned char *data;
+	void *pMap = 0;
+	size_t sz = 0; /* gcc warn */
+	int c;
+	/* Same as sod_img_load_from_file() but hand back the decoder's interleaved
+	 * 8-bit buffer as is, without the planar float conversion.
+	 */
+	if (SOD_OK != pVfs->xMmap(zFile, &pMap, &sz)) {
+		data = stbi_load(zFile, pWidth, pHeight, &c, nChannels);
+	}
+	else {
+		data = stbi_load_from_memory((const unsigned char *)pMap, (int)sz, pWidth, pHeight, &c, nChannels);
+		pVfs->xUnmap(pMap, sz);
+	}
+	return data;
+}
+/*
 * Extract path fields.
 */
 static int ExtractPathInfo(const char *zPath, size_t nByte, sod_path_info *pOut)
@@ -13702,18 +13976,42 @@ static int CmpSyString(SyString *pStr, const char *zIn)
 	return SyStringCmp(&sStr, pStr, sy_strnicmp);
 }
 /*
+* Files decoded at once by sod_img_set_load_from_directory(): enough to keep the threads
+* behind the parallel hook busy, few enough to bound the decoder memory alive at a time.
+*/
+#define SOD_IMG_SET_INFLIGHT 16
+typedef struct SodDirLoadJob SodDirLoadJob;
+struct SodDirLoadJob {
+	char **azPath; /* Candidate files, in load order */
+	sod_img *aImg; /* One image per file of the current window */
+	int iFirst;    /* First file of the current window */
+};
+static void SodDirLoadTask(void *pData, int iTask)
+{
+	SodDirLoadJob *pJob = (SodDirLoadJob *)pData;
+	pJob->aImg[iTask] = sod_img_load_from_file(pJob->azPath[pJob->iFirst + iTask], SOD_IMG_COLOR);
+}
+static int SodDirPathCmp(const void *pA, const void *pB)
+{
+	return strcmp(*(char * const *)pA, *(char * const *)pB);
+}
+/*
 * CAPIREF: Refer to the official documentation at https://sod.pixlab.io/api.html for the expected parameters this interface takes.
 */
 int sod_img_set_load_from_directory(const char * zPath, sod_img ** apLoaded, int * pnLoaded, int max_entries)
 {
 	static const char *zAllowed[] = { "png","jpg","jpeg","bmp","pgm","ppm","pbm","hdr","psd","tga","pic", 0 /*Marker*/ };
 	const sod_vfs *pVfs = sodExportBuiltinVfs();
+	sod_img aWindow[SOD_IMG_SET_INFLIGHT];
 	sod_path_info sPath;
+	SodDirLoadJob sJob;
 	SySet aEntries;
+	SySet aPaths;
 	SyBlob sReader;
+	size_t nDir = strlen(zPath);
+	char **azPath;
 	void *pHandle;
-	sod_img img;
-	int i, rc;
+	int i, nPath, rc;
 	/* Open the target directory */
 	rc = pVfs->xOpenDir(zPath, &pHandle);
 	if (rc != SOD_OK) {
@@ -13722,19 +14020,19 @@ int sod_img_set_load_from_directory(const char * zPath, sod_img ** apLoaded, int
 		return rc;
 	}
 	SySetInit(&aEntries, sizeof(sod_img));
+	SySetInit(&aPaths, sizeof(char *));
 	SyBlobInit(&sReader);
+	if (nDir > 0 && (zPath[nDir - 1] == '/' || zPath[nDir - 1] == '\\')) {
+		nDir--;
+	}
 
-	/* Iterate over the target directory */
-	pVfs->xChdir(zPath);
+	/* List the candidate files once. Entries are addressed relative to zPath rather than
+	 * through chdir(), the working directory is process wide and other threads may use it.
+	 */
 	while (pVfs->xDirRead(pHandle, &sReader) == SOD_OK) {
 		const char *zEntry = (const char *)SyBlobData(&sReader);
 		size_t nByte = SyBlobLength(&sReader);
-		/* Reset the blob */
-		SyBlobReset(&sReader);
-		if (pVfs->xIsdir(zEntry)) {
-			/* Entry is a directory, ignore */
-			continue;
-		}
+		char *zFull;
 		/* Make sure the file is of the correct extension */
 		ExtractPathInfo(zEntry, nByte, &sPath);
 		rc = 0;
@@ -13746,28 +14044,74 @@ int sod_img_set_load_from_directory(const char * zPath, sod_img ** apLoaded, int
 		}
 		if (!rc) {
 			/* Not of the expected extension */
+			SyBlobReset(&sReader);
 			continue;
 		}
-		if (max_entries > 0 && (int)SySetUsed(&aEntries) >= max_entries) {
-			/* Maximum samples to collect limit reached */
-			break;
-		}
-		/* Load the image */
-		img = sod_img_load_from_file(zEntry, SOD_IMG_COLOR);
-		if (img.data == 0) {
-			/* Cannot load image, ignore */
+		zFull = (char *)malloc(nDir + nByte + 2);
+		if (zFull == 0) {
+			SyBlobReset(&sReader);
 			continue;
 		}
-		/* Insert in the target set */
-		rc = SySetPut(&aEntries, (const void *)&img);
-		if (rc != SOD_OK) {
-			/* Avoid memory leaks */
-			sod_free_image(img);
+		memcpy(zFull, zPath, nDir);
+		zFull[nDir] = '/';
+		memcpy(&zFull[nDir + 1], zEntry, nByte);
+		zFull[nDir + 1 + nByte] = 0;
+		/* Reset the blob */
+		SyBlobReset(&sReader);
+		if (pVfs->xIsdir(zFull) || SySetPut(&aPaths, (const void *)&zFull) != SOD_OK) {
+			/* Entry is a directory, ignore */
+			free(zFull);
 		}
 	}
-	/* Cleanup */
 	pVfs->xCloseDir(pHandle);
 	SyBlobRelease(&sReader);
+
+	/* Directory order is up to the file system, load in name order instead */
+	azPath = (char **)SySetBasePtr(&aPaths);
+	nPath = (int)SySetUsed(&aPaths);
+	if (nPath > 1) {
+		qsort(azPath, nPath, sizeof(char *), SodDirPathCmp);
+	}
+
+	/* Decode a window of files at a time through the parallel hook */
+	sJob.azPath = azPath;
+	sJob.aImg = aWindow;
+	sJob.iFirst = 0;
+	while (sJob.iFirst < nPath) {
+		int nWindow = nPath - sJob.iFirst;
+		if (nWindow > SOD_IMG_SET_INFLIGHT) {
+			nWindow = SOD_IMG_SET_INFLIGHT;
+		}
+		if (max_entries > 0) {
+			int nWanted = max_entries - (int)SySetUsed(&aEntries);
+			if (nWanted <= 0) {
+				/* Maximum samples to collect limit reached */
+				break;
+			}
+			if (nWindow > nWanted) {
+				nWindow = nWanted;
+			}
+		}
+		SodParallelRun(nWindow, SodDirLoadTask, &sJob);
+		for (i = 0; i < nWindow; i++) {
+			if (aWindow[i].data == 0) {
+				/* Cannot load image, ignore */
+				continue;
+			}
+			/* Insert in the target set */
+			rc = SySetPut(&aEntries, (const void *)&aWindow[i]);
+			if (rc != SOD_OK) {
+				/* Avoid memory leaks */
+				sod_free_image(aWindow[i]);
+			}
+		}
+		sJob.iFirst += nWindow;
+	}
+	/* Cleanup */
+	for (i = 0; i < nPath; i++) {
+		free(azPath[i]);
+	}
+	SySetRelease(&aPaths);
 	/* Total loaded images from this directory */
 	*apLoaded = (sod_img *)SySetBasePtr(&aEntries);
 	*pnLoaded = (int)SySetUsed(&aEntries);
@@ -13786,6 +14130,8 @@ void sod_img_set_release(sod_img *aLoaded, int nEntries)
 }
 #ifndef SOD_DISABLE_IMG_WRITER
 #define STB_IMAGE_WRITE_IMPLEMENTATION
+/* Restart strips of parallel JPEG encodes go through the installed parallel hook */
+#define STBIW_PARALLEL(n,task,data) SodParallelRun(n, task, data)
 #include"sod_img_writer.h"
 /*
 * CAPIREF: Refer to the official documentation at https://sod.pixlab.io/api.html for the expected parameters this interface takes.
@@ -13834,6 +14180,156 @@ int sod_img_blob_save_as_jpeg(const char * zPath, const unsigned char *zBlob, in
 	return rc ? SOD_OK : SOD_IOERR;
 }
 /*
+* MCU rows per restart strip when encoding with SOD_JPEG_PARALLEL: small enough to give every
+* thread a few strips on common image sizes, large enough that the markers cost next to nothing.
+*/
+#define SOD_JPEG_RESTART_ROWS 4
+/*
+* CAPIREF: Refer to the official documentation at https://sod.pixlab.io/api.html for the expected parameters this interface takes.
+*/
+int sod_img_blob_save_as_jpeg_ext(const char * zPath, const unsigned char *zBlob, int width, int height, int nChannels, int Quality, int iFlags)
+{
+	int rc;
+	rc = stbi_write_jpg_ext(zPath, width, height, nChannels, (const void *)zBlob, Quality < 0 ? 100 : Quality,
+		(iFlags & SOD_JPEG_SUBSAMPLE_420) != 0, (iFlags & SOD_JPEG_BUFFERED_OUTPUT) != 0,
+		(iFlags & SOD_JPEG_PARALLEL) ? SOD_JPEG_RESTART_ROWS : 0);
+	return rc ? SOD_OK : SOD_IOERR;
+}
+/*
+* CAPIREF: Refer to the official documentation at https://sod.pixlab.io/api.html for the expected parameters this interface takes.
+*/
+sod_jpeg_stream * sod_img_jpeg_stream_begin(const char *zPath, int width, int height, int nChannels, int Quality, int iFlags)
+{
+	/* Rows are encoded as they arrive, into a single scan (SOD_JPEG_PARALLEL does not apply) */
+	return (sod_jpeg_stream *)stbi_write_jpg_stream_begin(zPath, width, height, nChannels, Quality < 0 ? 100 : Quality,
+		(iFlags & SOD_JPEG_SUBSAMPLE_420) != 0, (iFlags & SOD_JPEG_BUFFERED_OUTPUT) != 0);
+}
+/*
+* CAPIREF: Refer to the official documentation at https://sod.pixlab.io/api.html for the expected parameters this interface takes.
+*/
+int sod_img_jpeg_stream_write(sod_jpeg_stream *pStream, const unsigned char *zRows, int nRows)
+{
+	int rc;
+	rc = stbi_write_jpg_stream_rows((stbi_write_jpg_stream *)pStream, (const void *)zRows, nRows);
+	return rc ? SOD_OK : SOD_IOERR;
+}
+/*
+* CAPIREF: Refer to the official documentation at https://sod.pixlab.io/api.html for the expected parameters this interface takes.
+*/
+int sod_img_jpeg_stream_end(sod_jpeg_stream *pStream)
+{
+	int rc;
+	rc = stbi_write_jpg_stream_end((stbi_write_jpg_stream *)pStream);
+	return rc ? SOD_OK : SOD_IOERR;
+}
+/*
+* Move one 8x8 block of quantized coefficients (natural order, row = vertical frequency v,
+* column = horizontal frequency u) through a lossless transform. Mirroring an axis negates
+* the odd frequencies along it, the quarter turns also transpose the block.
+*/
+static void SodJpegTransformBlock(int iTransform, const short *pSrc, short *pDst)
+{
+	int u, v;
+	for (v = 0; v < 8; ++v) {
+		for (u = 0; u < 8; ++u) {
+			int c;
+			switch (iTransform) {
+			case SOD_JPEG_ROTATE_90:  c = (u & 1) ? -pSrc[u * 8 + v] : pSrc[u * 8 + v]; break;
+			case SOD_JPEG_ROTATE_270: c = (v & 1) ? -pSrc[u * 8 + v] : pSrc[u * 8 + v]; break;
+			case SOD_JPEG_ROTATE_180: c = ((u ^ v) & 1) ? -pSrc[v * 8 + u] : pSrc[v * 8 + u]; break;
+			case SOD_JPEG_FLIP_H:     c = (u & 1) ? -pSrc[v * 8 + u] : pSrc[v * 8 + u]; break;
+			default:                  c = (v & 1) ? -pSrc[v * 8 + u] : pSrc[v * 8 + u]; break;
+			}
+			pDst[v * 8 + u] = (short)c;
+		}
+	}
+}
+/*
+* CAPIREF: Refer to the official documentation at https://sod.pixlab.io/api.html for the expected parameters this interface takes.
+*/
+int sod_img_jpeg_transform(const char *zSrc, const char *zDst, int iTransform)
+{
+	const sod_vfs *pVfs = sodExportBuiltinVfs();
+	stbi_jpeg_coefficients sCoeff;
+	stbi_write_jpg_component aComp[3];
+	short *apDst[3] = { 0, 0, 0 };
+	unsigned short aQuant[4][64];
+	int bTranspose, bMirrorX, bMirrorY;
+	int n, t, bx, by, rc = SOD_OK;
+	void *pMap = 0;
+	size_t sz;
+	switch (iTransform) {
+	case SOD_JPEG_ROTATE_90:  bTranspose = 1; bMirrorX = 0; bMirrorY = 1; break;
+	case SOD_JPEG_ROTATE_180: bTranspose = 0; bMirrorX = 1; bMirrorY = 1; break;
+	case SOD_JPEG_ROTATE_270: bTranspose = 1; bMirrorX = 1; bMirrorY = 0; break;
+	case SOD_JPEG_FLIP_H:     bTranspose = 0; bMirrorX = 1; bMirrorY = 0; break;
+	case SOD_JPEG_FLIP_V:     bTranspose = 0; bMirrorX = 0; bMirrorY = 1; break;
+	default:
+		return SOD_UNSUPPORTED;
+	}
+	if (SOD_OK != pVfs->xMmap(zSrc, &pMap, &sz)) {
+		return SOD_IOERR;
+	}
+	if (!stbi_jpeg_load_coefficients_from_memory((const stbi_uc *)pMap, (int)sz, &sCoeff)) {
+		/* Not a JPEG (or not one we can read without decoding) */
+		pVfs->xUnmap(pMap, sz);
+		return SOD_UNSUPPORTED;
+	}
+	pVfs->xUnmap(pMap, sz);
+	/*
+	* The partial MCU at the right/bottom edge has to stay there: the mirrored source axes
+	* (bMirrorX is the source x axis, bMirrorY the source y axis) must hold whole MCUs.
+	*/
+	if (sCoeff.is_rgb || (bMirrorX && sCoeff.x % (8 * sCoeff.h_max)) || (bMirrorY && sCoeff.y % (8 * sCoeff.v_max))) {
+		stbi_jpeg_free_coefficients(&sCoeff);
+		return SOD_UNSUPPORTED;
+	}
+	/* Quarter turns swap the frequency axes, so the quantization tables are transposed as well */
+	for (t = 0; t < 4; ++t) {
+		for (by = 0; by < 8; ++by) {
+			for (bx = 0; bx < 8; ++bx) {
+				aQuant[t][by * 8 + bx] = bTranspose ? sCoeff.quant[t][bx * 8 + by] : sCoeff.quant[t][by * 8 + bx];
+			}
+		}
+	}
+	for (n = 0; n < sCoeff.n; ++n) {
+		const stbi_jpeg_component *pSrc = &sCoeff.comp[n];
+		int bw = bTranspose ? pSrc->blocks_h : pSrc->blocks_w;
+		int bh = bTranspose ? pSrc->blocks_w : pSrc->blocks_h;
+		apDst[n] = (short *)malloc((size_t)bw * bh * 64 * sizeof(short));
+		if (apDst[n] == 0) {
+			rc = SOD_OUTOFMEM;
+			break;
+		}
+		for (by = 0; by < bh; ++by) {
+			for (bx = 0; bx < bw; ++bx) {
+				/* Source block landing at (bx,by) */
+				int sx = bTranspose ? by : bx;
+				int sy = bTranspose ? bx : by;
+				if (bMirrorX) sx = pSrc->blocks_w - 1 - sx;
+				if (bMirrorY) sy = pSrc->blocks_h - 1 - sy;
+				SodJpegTransformBlock(iTransform, &pSrc->coeff[64 * (sy * pSrc->blocks_w + sx)], &apDst[n][64 * (by * bw + bx)]);
+			}
+		}
+		aComp[n].id = pSrc->id;
+		aComp[n].h = bTranspose ? pSrc->v : pSrc->h;
+		aComp[n].v = bTranspose ? pSrc->h : pSrc->v;
+		aComp[n].tq = pSrc->tq;
+		aComp[n].blocks_w = bw;
+		aComp[n].coeff = apDst[n];
+	}
+	if (rc == SOD_OK) {
+		int w = bTranspose ? sCoeff.y : sCoeff.x;
+		int h = bTranspose ? sCoeff.x : sCoeff.y;
+		rc = stbi_write_jpg_coefficients(zDst, w, h, sCoeff.n, aComp, (const unsigned short(*)[64])aQuant) ? SOD_OK : SOD_IOERR;
+	}
+	for (n = 0; n < sCoeff.n; ++n) {
+		free(apDst[n]);
+	}
+	stbi_jpeg_free_coefficients(&sCoeff);
+	return rc;
+}
+/*
 * CAPIREF: Refer to the official documentation at https://sod.pixlab.io/api.html for the expected parameters this interface takes.
 */
 int sod_img_blob_save_as_bmp(const char * zPath, const unsigned char *zBlob, int width, int height, int nChannels)
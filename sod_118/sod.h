@@ -77,6 +77,9 @@ typedef struct sod_img sod_img;
 /* 
  * Point instance documented at https://sod.pixlab.io/api.html#sod_pts. */
 typedef struct sod_pts sod_pts;
+/*
+ * Row-band JPEG encoder handle, see `sod_img_jpeg_stream_begin()`. */
+typedef struct sod_jpeg_stream sod_jpeg_stream;
 /* 
  * RealNets model handle documented at https://sod.pixlab.io/api.html#sod_realnet_model_handle. */
 typedef unsigned int sod_realnet_model_handle;
@@ -167,11 +170,39 @@ typedef void (*ProcRnnCallback)(const char *, size_t, void *);
 * The documentation is available to consult at https://sod.pixlab.io/c_api/sod_cnn_config.html.
 */
 typedef void(*ProcLogCallback)(const char *, size_t, void *);
+/*
+* Parallel runner callback to be installed via `sod_set_parallel_hook()`.
+*
+* The runner must invoke xTask(pTaskData, iTask) exactly once for each iTask in [0, nTasks)
+* (in any order, from any thread) and return only when all of them have completed.
+*/
+typedef void(*ProcSodParallel)(void *pUserData, int nTasks, void(*xTask)(void *pTaskData, int iTask), void *pTaskData);
+/*
+* Band consumer callback to be used in conjunction with the `sod_img_load_bands_from_file()` interface.
+*
+* Receives nRows interleaved rows starting at image row iFirstRow (bands arrive top to bottom
+* and may be modified in place). Return zero to stop decoding.
+*/
+typedef int(*ProcSodImgBand)(void *pUserData, unsigned char *zRows, int iFirstRow, int nRows, int width, int height);
 /* 
  * Macros to be used in conjunction with the `sod_img_load_from_file()` or `sod_img_load_from_mem()` interfaces.
  */
 #define SOD_IMG_COLOR     0 /* Load full color channels. */
 #define SOD_IMG_GRAYSCALE 1 /* Load an image in the grayscale colorpsace only (single channel). */
+/*
+ * Flags to be used in conjunction with the `sod_img_blob_save_as_jpeg_ext()` interface.
+ */
+#define SOD_JPEG_SUBSAMPLE_420   0x01 /* Store the chroma planes at half resolution (4:2:0 instead of 4:4:4). */
+#define SOD_JPEG_BUFFERED_OUTPUT 0x02 /* Buffer the entropy coded output (same bytes, fewer write calls). */
+#define SOD_JPEG_PARALLEL        0x04 /* Cut the scan into restart strips coded through the parallel hook. */
+/*
+ * Lossless transforms to be used in conjunction with the `sod_img_jpeg_transform()` interface.
+ */
+#define SOD_JPEG_ROTATE_90  1 /* Rotate 90 degrees clockwise. */
+#define SOD_JPEG_ROTATE_180 2 /* Rotate 180 degrees. */
+#define SOD_JPEG_ROTATE_270 3 /* Rotate 270 degrees clockwise. */
+#define SOD_JPEG_FLIP_H     4 /* Mirror left to right. */
+#define SOD_JPEG_FLIP_V     5 /* Mirror top to bottom. */
 /* 
  * Macros around a stack allocated `sod_img` instance.
  */
@@ -273,6 +304,9 @@ SOD_APIEXPORT void sod_free_image(sod_img m);
 #ifndef SOD_DISABLE_IMG_READER
 SOD_APIEXPORT sod_img sod_img_load_from_file(const char *zFile, int nChannels);
 SOD_APIEXPORT sod_img sod_img_load_from_mem(const unsigned char *zBuf, int buf_len, int nChannels);
+SOD_APIEXPORT unsigned char * sod_img_load_blob_from_file(const char *zFile, int *pWidth, int *pHeight, int nChannels);
+SOD_APIEXPORT sod_img sod_img_load_from_file_scaled(const char *zFile, int nChannels, int iDenom);
+SOD_APIEXPORT int  sod_img_load_bands_from_file(const char *zFile, int nChannels, ProcSodImgBand xBand, void *pUserData);
 SOD_APIEXPORT int  sod_img_set_load_from_directory(const char *zPath, sod_img ** apLoaded, int * pnLoaded, int max_entries);
 SOD_APIEXPORT void sod_img_set_release(sod_img *aLoaded, int nEntries);
 #ifndef SOD_DISABLE_IMG_WRITER
@@ -280,6 +314,11 @@ SOD_APIEXPORT int sod_img_save_as_png(sod_img input, const char *zPath);
 SOD_APIEXPORT int sod_img_save_as_jpeg(sod_img input, const char *zPath, int Quality);
 SOD_APIEXPORT int sod_img_blob_save_as_png(const char * zPath, const unsigned char *zBlob, int width, int height, int nChannels);
 SOD_APIEXPORT int sod_img_blob_save_as_jpeg(const char * zPath, const unsigned char *zBlob, int width, int height, int nChannels, int Quality);
+SOD_APIEXPORT int sod_img_blob_save_as_jpeg_ext(const char * zPath, const unsigned char *zBlob, int width, int height, int nChannels, int Quality, int iFlags);
+SOD_APIEXPORT int sod_img_jpeg_transform(const char *zSrc, const char *zDst, int iTransform);
+SOD_APIEXPORT sod_jpeg_stream * sod_img_jpeg_stream_begin(const char *zPath, int width, int height, int nChannels, int Quality, int iFlags);
+SOD_APIEXPORT int sod_img_jpeg_stream_write(sod_jpeg_stream *pStream, const unsigned char *zRows, int nRows);
+SOD_APIEXPORT int sod_img_jpeg_stream_end(sod_jpeg_stream *pStream);
 SOD_APIEXPORT int sod_img_blob_save_as_bmp(const char * zPath, const unsigned char *zBlob, int width, int height, int nChannels);
 #endif /* SOD_DISABLE_IMG_WRITER */
 #define sod_img_load_color(zPath) sod_img_load_from_file(zPath, SOD_IMG_COLOR)
@@ -357,6 +396,9 @@ SOD_APIEXPORT void sod_image_draw_line(sod_img im, sod_pts start, sod_pts end, f
 
 SOD_APIEXPORT unsigned char * sod_image_to_blob(sod_img im);
 SOD_APIEXPORT void sod_image_free_blob(unsigned char *zBlob);
+SOD_APIEXPORT void sod_img_blob_to_planar(const unsigned char *zBlob, float *pOut, int width, int height, int nChannels);
+SOD_APIEXPORT void sod_img_planar_to_blob(const float *pIn, unsigned char *zBlob, int width, int height, int nChannels);
+SOD_APIEXPORT void sod_set_parallel_hook(ProcSodParallel xParallel, void *pUserData);
 /*
  * OpenCV Integration API. The library must be compiled against OpenCV
  * with the compile-time directive SOD_ENABLE_OPENCV defined.
@@ -371,6 +371,17 @@ extern "C" {
 
 	STBIDEF stbi_uc *stbi_load_from_memory(stbi_uc           const *buffer, int len, int *x, int *y, int *channels_in_file, int desired_channels);
 	STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *channels_in_file, int desired_channels);
+	// same as stbi_load_from_memory, at 1/denom (2, 4 or 8) of the size: JPEGs run a
+	// reduced idct, other formats are box filtered after decoding
+	STBIDEF stbi_uc *stbi_load_from_memory_scaled(stbi_uc const *buffer, int len, int *x, int *y, int *channels_in_file, int desired_channels, int denom);
+	// receives consecutive bands of rows, top to bottom, of a width x height image;
+	// the rows may be modified in place, return 0 to stop decoding
+	typedef int stbi_band_func(void *user, stbi_uc *rows, int y, int nrows, int width, int height);
+	// decode the image a band of rows at a time: baseline JPEGs are decoded one MCU row
+	// at a time (so only a few rows are ever held), anything else is decoded whole and
+	// then handed out in bands. stbi_set_flip_vertically_on_load does not apply.
+	// Returns 0 on failure or when func stopped early.
+	STBIDEF int      stbi_load_bands_from_memory(stbi_uc const *buffer, int len, int desired_channels, stbi_band_func *func, void *user);
 #ifndef STBI_NO_GIF
 	STBIDEF stbi_uc *stbi_load_gif_from_memory(stbi_uc const *buffer, int len, int **delays, int *x, int *y, int *z, int *comp, int req_comp);
 #endif
@@ -380,6 +391,9 @@ extern "C" {
 	STBIDEF stbi_uc *stbi_load(char const *filename, int *x, int *y, int *channels_in_file, int desired_channels);
 	STBIDEF stbi_uc *stbi_load_from_file(FILE *f, int *x, int *y, int *channels_in_file, int desired_channels);
 	// for stbi_load_from_file, file pointer is left pointing immediately after image
+	// same as stbi_load/stbi_load_from_file at 1/denom of the size (see stbi_load_from_memory_scaled)
+	STBIDEF stbi_uc *stbi_load_scaled(char const *filename, int *x, int *y, int *channels_in_file, int desired_channels, int denom);
+	STBIDEF stbi_uc *stbi_load_from_file_scaled(FILE *f, int *x, int *y, int *channels_in_file, int desired_channels, int denom);
 #endif
 
 	////////////////////////////////////
@@ -448,6 +462,30 @@ extern "C" {
 	STBIDEF int      stbi_is_16_bit_from_file(FILE *f);
 #endif
 
+#ifndef STBI_NO_JPEG
+	// quantized DCT coefficients of a baseline or progressive JPEG, for
+	// transforms that must not go through the idct (lossless rotate/flip)
+	typedef struct
+	{
+		int id, h, v, tq;         // component id, sampling factors, quantization table
+		int blocks_w, blocks_h;   // 8x8 blocks stored, padded out to whole MCUs
+		short *coeff;             // 64 coefficients per block, natural order
+		void *raw_coeff;
+	} stbi_jpeg_component;
+
+	typedef struct
+	{
+		int x, y, n;              // image size and component count (1 or 3)
+		int is_rgb;               // components are R,G,B rather than Y,Cb,Cr
+		int h_max, v_max;         // largest sampling factors (MCU is 8*h_max x 8*v_max)
+		unsigned short quant[4][64]; // quantization tables, natural order
+		stbi_jpeg_component comp[4];
+	} stbi_jpeg_coefficients;
+
+	STBIDEF int      stbi_jpeg_load_coefficients_from_memory(stbi_uc const *buffer, int len, stbi_jpeg_coefficients *out);
+	STBIDEF void     stbi_jpeg_free_coefficients(stbi_jpeg_coefficients *c);
+#endif
+
 
 
 	// for image formats that explicitly notate that they have premultiplied alpha,
@@ -541,6 +579,25 @@ extern "C" {
 #define STBI_ASSERT(x) assert(x)
 #endif
 
+// #define STBI_PARALLEL(n,task,data) to run task(data, i) for i in [0, n) on several threads
+// (returning once they are all done); the JPEG decoder then handles restart segments and
+// the resample/colour conversion strips concurrently.
+#ifndef STBI_PARALLEL
+#define STBI_PARALLEL(n,task,data) do { int stbi__t; for (stbi__t = 0; stbi__t < (n); ++stbi__t) (task)((data), stbi__t); } while (0)
+#endif
+
+#ifndef STBI_THREAD_LOCAL
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#define STBI_THREAD_LOCAL _Thread_local
+#elif defined(__GNUC__)
+#define STBI_THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+#define STBI_THREAD_LOCAL __declspec(thread)
+#else
+#define STBI_THREAD_LOCAL
+#endif
+#endif
+
 
 #ifndef _MSC_VER
 #ifdef __cplusplus
@@ -718,6 +775,8 @@ typedef struct
 
 	stbi_uc *img_buffer, *img_buffer_end;
 	stbi_uc *img_buffer_original, *img_buffer_original_end;
+
+	int scale;  // requested reduction: 1, 2, 4 or 8 (see stbi_load_from_memory_scaled)
 } stbi__context;
 
 
@@ -726,6 +785,7 @@ static void stbi__refill_buffer(stbi__context *s);
 // initialize a memory-decode context
 static void stbi__start_mem(stbi__context *s, stbi_uc const *buffer, int len)
 {
+	s->scale = 1;
 	s->io.read = NULL;
 	s->read_from_callbacks = 0;
 	s->img_buffer = s->img_buffer_original = (stbi_uc *)buffer;
@@ -735,6 +795,7 @@ static void stbi__start_mem(stbi__context *s, stbi_uc const *buffer, int len)
 // initialize a callback-based context
 static void stbi__start_callbacks(stbi__context *s, stbi_io_callbacks *c, void *user)
 {
+	s->scale = 1;
 	s->io = *c;
 	s->io_user_data = user;
 	s->buflen = sizeof(s->buffer_start);
@@ -797,12 +858,14 @@ typedef struct
 	int bits_per_channel;
 	int num_channels;
 	int channel_order;
+	int scale;  // reduction already applied by the decoder
 } stbi__result_info;
 
 #ifndef STBI_NO_JPEG
 static int      stbi__jpeg_test(stbi__context *s);
 static void    *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri);
 static int      stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp);
+static int      stbi__jpeg_load_bands(stbi__context *s, int req_comp, stbi_band_func *func, void *user);
 #endif
 
 #ifndef STBI_NO_PNG
@@ -856,8 +919,8 @@ static void    *stbi__pnm_load(stbi__context *s, int *x, int *y, int *comp, int
 static int      stbi__pnm_info(stbi__context *s, int *x, int *y, int *comp);
 #endif
 
-// this is not threadsafe
-static const char *stbi__g_failure_reason;
+// one per thread, so that parallel decode tasks can report errors
+static STBI_THREAD_LOCAL const char *stbi__g_failure_reason;
 
 STBIDEF const char *stbi_failure_reason(void)
 {
@@ -991,6 +1054,7 @@ static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int re
 	ri->bits_per_channel = 8; // default is 8 so most paths don't have to be changed
 	ri->channel_order = STBI_ORDER_RGB; // all current input & output are this, but this is here so we can add BGR order
 	ri->num_channels = 0;
+	ri->scale = 1;
 
 #ifndef STBI_NO_JPEG
 	if (stbi__jpeg_test(s)) return stbi__jpeg_load(s, x, y, comp, req_comp, ri);
@@ -1098,6 +1162,36 @@ static void stbi__vertical_flip_slices(void *image, int w, int h, int z, int byt
 	}
 }
 
+// average f x f boxes of an 8-bit image (partial boxes at the right/bottom edges included)
+static stbi_uc *stbi__box_reduce(stbi_uc *data, int *x, int *y, int n, int f)
+{
+	int w = (*x + f - 1) / f, h = (*y + f - 1) / f;
+	int i, j, k, u, v;
+	stbi_uc *out = (stbi_uc *)stbi__malloc_mad3(w, h, n, 0);
+	if (out == NULL) {
+		STBI_FREE(data);
+		return stbi__errpuc("outofmem", "Out of memory");
+	}
+	for (j = 0; j < h; ++j) {
+		int v1 = (j + 1) * f < *y ? (j + 1) * f : *y;
+		for (i = 0; i < w; ++i) {
+			int u1 = (i + 1) * f < *x ? (i + 1) * f : *x;
+			int count = (v1 - j * f) * (u1 - i * f);
+			for (k = 0; k < n; ++k) {
+				int sum = 0;
+				for (v = j * f; v < v1; ++v)
+					for (u = i * f; u < u1; ++u)
+						sum += data[((size_t)v * *x + u) * n + k];
+				out[((size_t)j * w + i) * n + k] = (stbi_uc)((sum + count / 2) / count);
+			}
+		}
+	}
+	STBI_FREE(data);
+	*x = w;
+	*y = h;
+	return out;
+}
+
 static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x, int *y, int *comp, int req_comp)
 {
 	stbi__result_info ri;
@@ -1112,6 +1206,13 @@ static unsigned char *stbi__load_and_postprocess_8bit(stbi__context *s, int *x,
 		ri.bits_per_channel = 8;
 	}
 
+	// formats that can't decode at a reduced size are shrunk afterwards
+	if (s->scale > ri.scale) {
+		result = stbi__box_reduce((stbi_uc *)result, x, y, req_comp ? req_comp : *comp, s->scale / ri.scale);
+		if (result == NULL)
+			return NULL;
+	}
+
 	// @TODO: move stbi__convert_format to here
 
 	if (stbi__vertically_flip_on_load) {
@@ -1195,6 +1296,32 @@ STBIDEF stbi_uc *stbi_load_from_file(FILE *f, int *x, int *y, int *comp, int req
 	return result;
 }
 
+STBIDEF stbi_uc *stbi_load_scaled(char const *filename, int *x, int *y, int *comp, int req_comp, int denom)
+{
+	FILE *f = stbi__fopen(filename, "rb");
+	unsigned char *result;
+	if (!f) return stbi__errpuc("can't fopen", "Unable to open file");
+	result = stbi_load_from_file_scaled(f, x, y, comp, req_comp, denom);
+	fclose(f);
+	return result;
+}
+
+STBIDEF stbi_uc *stbi_load_from_file_scaled(FILE *f, int *x, int *y, int *comp, int req_comp, int denom)
+{
+	unsigned char *result;
+	stbi__context s;
+	if (denom != 1 && denom != 2 && denom != 4 && denom != 8)
+		return stbi__errpuc("bad scale", "Scale must be 1, 2, 4 or 8");
+	stbi__start_file(&s, f);
+	s.scale = denom;
+	result = stbi__load_and_postprocess_8bit(&s, x, y, comp, req_comp);
+	if (result) {
+		// need to 'unget' all the characters in the IO buffer
+		fseek(f, -(int)(s.img_buffer_end - s.img_buffer), SEEK_CUR);
+	}
+	return result;
+}
+
 STBIDEF stbi__uint16 *stbi_load_from_file_16(FILE *f, int *x, int *y, int *comp, int req_comp)
 {
 	stbi__uint16 *result;
@@ -1242,6 +1369,51 @@ STBIDEF stbi_uc *stbi_load_from_memory(stbi_uc const *buffer, int len, int *x, i
 	return stbi__load_and_postprocess_8bit(&s, x, y, comp, req_comp);
 }
 
+STBIDEF stbi_uc *stbi_load_from_memory_scaled(stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp, int denom)
+{
+	stbi__context s;
+	if (denom != 1 && denom != 2 && denom != 4 && denom != 8)
+		return stbi__errpuc("bad scale", "Scale must be 1, 2, 4 or 8");
+	stbi__start_mem(&s, buffer, len);
+	s.scale = denom;
+	return stbi__load_and_postprocess_8bit(&s, x, y, comp, req_comp);
+}
+
+// rows per band when an image that can't be streamed is handed out whole
+#define STBI__BAND_ROWS 16
+
+STBIDEF int stbi_load_bands_from_memory(stbi_uc const *buffer, int len, int desired_channels, stbi_band_func *func, void *user)
+{
+	stbi__context s;
+	stbi__result_info ri;
+	stbi_uc *result;
+	int x, y, comp, n, y0, ok = 1;
+
+	if (desired_channels < 0 || desired_channels > 4) return stbi__err("bad req_comp", "Internal error");
+	stbi__start_mem(&s, buffer, len);
+#ifndef STBI_NO_JPEG
+	if (stbi__jpeg_test(&s)) {
+		ok = stbi__jpeg_load_bands(&s, desired_channels, func, user);
+		if (ok >= 0) return ok;
+		stbi__rewind(&s);
+		ok = 1;
+	}
+#endif
+	result = (stbi_uc *)stbi__load_main(&s, &x, &y, &comp, desired_channels, &ri, 8);
+	if (result == NULL)
+		return 0;
+	if (ri.bits_per_channel != 8) {
+		result = stbi__convert_16_to_8((stbi__uint16 *)result, x, y, desired_channels ? desired_channels : comp);
+		if (result == NULL)
+			return 0;
+	}
+	n = desired_channels ? desired_channels : comp;
+	for (y0 = 0; y0 < y && ok; y0 += STBI__BAND_ROWS)
+		ok = func(user, result + (size_t)y0 * x * n, y0, y - y0 < STBI__BAND_ROWS ? y - y0 : STBI__BAND_ROWS, x, y);
+	STBI_FREE(result);
+	return ok;
+}
+
 STBIDEF stbi_uc *stbi_load_from_callbacks(stbi_io_callbacks const *clbk, void *user, int *x, int *y, int *comp, int req_comp)
 {
 	stbi__context s;
@@ -1759,6 +1931,9 @@ typedef struct
 	int            jfif;
 	int            app14_color_transform; // Adobe APP14 tag
 	int            rgb;
+	int            coeff_only;  // keep the quantized coefficients, skip idct
+	int            block_size;  // pixels per side of a decoded block: 8, or 4/2/1 when scaled
+	int            stream;      // component buffers only hold two MCU rows (see stbi_load_bands_from_memory)
 
 	int scan_n, order[4];
 	int restart_interval, todo;
@@ -2289,6 +2464,60 @@ static void stbi__idct_block(stbi_uc *out, int out_stride, short data[64])
 	}
 }
 
+// Reduced idcts for scaled decodes: every output pixel samples the block's low
+// frequencies at the centre of the 2x2 or 4x4 area it stands for. Same fixed point
+// scheme as above, the first pass keeps 2 extra bits which the second one drops.
+static const int stbi__idct_basis_2[4] = { // [u][x]
+	stbi__f2f(0.353553391),  stbi__f2f(0.353553391),
+	stbi__f2f(0.353553391), -stbi__f2f(0.353553391)
+};
+static const int stbi__idct_basis_4[16] = {
+	stbi__f2f(0.353553391),  stbi__f2f(0.353553391),  stbi__f2f(0.353553391),  stbi__f2f(0.353553391),
+	stbi__f2f(0.461939766),  stbi__f2f(0.191341716), -stbi__f2f(0.191341716), -stbi__f2f(0.461939766),
+	stbi__f2f(0.353553391), -stbi__f2f(0.353553391), -stbi__f2f(0.353553391),  stbi__f2f(0.353553391),
+	stbi__f2f(0.191341716), -stbi__f2f(0.461939766),  stbi__f2f(0.461939766), -stbi__f2f(0.191341716)
+};
+
+static void stbi__idct_reduced(stbi_uc *out, int out_stride, short data[64], int size, const int *basis)
+{
+	int tmp[16], x, y, u, v;
+	// rows of coefficients -> horizontal samples
+	for (v = 0; v < size; ++v) {
+		for (x = 0; x < size; ++x) {
+			int t = 0;
+			for (u = 0; u < size; ++u)
+				t += basis[u * size + x] * data[v * 8 + u];
+			tmp[v * size + x] = (t + 512) >> 10;
+		}
+	}
+	// columns -> pixels, rounding and adding the 128 level shift
+	for (y = 0; y < size; ++y, out += out_stride) {
+		for (x = 0; x < size; ++x) {
+			int t = (1 << 13) + (128 << 14);
+			for (v = 0; v < size; ++v)
+				t += basis[v * size + y] * tmp[v * size + x];
+			out[x] = stbi__clamp(t >> 14);
+		}
+	}
+}
+
+static void stbi__idct_block_4(stbi_uc *out, int out_stride, short data[64])
+{
+	stbi__idct_reduced(out, out_stride, data, 4, stbi__idct_basis_4);
+}
+
+static void stbi__idct_block_2(stbi_uc *out, int out_stride, short data[64])
+{
+	stbi__idct_reduced(out, out_stride, data, 2, stbi__idct_basis_2);
+}
+
+static void stbi__idct_block_1(stbi_uc *out, int out_stride, short data[64])
+{
+	// DC only: the average of the block
+	STBI_NOTUSED(out_stride);
+	out[0] = stbi__clamp((data[0] + 4 + (128 << 3)) >> 3);
+}
+
 #ifdef STBI_SSE2
 // sse2 integer IDCT. not the fastest possible implementation but it
 // produces bit-identical results to the generic C version so it's
@@ -2712,6 +2941,25 @@ static void stbi__jpeg_reset(stbi__jpeg *j)
 	// since we don't even allow 1<<30 pixels
 }
 
+// baseline blocks are either kept as quantized coefficients (for lossless
+// transforms) or dequantized and sent straight through the idct
+static stbi__uint16 *stbi__jpeg_block_dequant(stbi__jpeg *z, int n)
+{
+	static stbi__uint16 unit[64] = {
+		1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1,
+		1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1
+	};
+	return z->coeff_only ? unit : z->dequant[z->img_comp[n].tq];
+}
+
+static void stbi__jpeg_put_block(stbi__jpeg *z, int n, int bx, int by, short data[64])
+{
+	if (z->coeff_only)
+		memcpy(z->img_comp[n].coeff + 64 * (bx + by * z->img_comp[n].coeff_w), data, 64 * sizeof(short));
+	else
+		z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2*by * z->block_size + bx * z->block_size, z->img_comp[n].w2, data);
+}
+
 static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
 {
 	stbi__jpeg_reset(z);
@@ -2729,8 +2977,8 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
 			for (j = 0; j < h; ++j) {
 				for (i = 0; i < w; ++i) {
 					int ha = z->img_comp[n].ha;
-					if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-					z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2*j * 8 + i * 8, z->img_comp[n].w2, data);
+					if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, stbi__jpeg_block_dequant(z, n))) return 0;
+					stbi__jpeg_put_block(z, n, i, j, data);
 					// every data block is an MCU, so countdown the restart interval
 					if (--z->todo <= 0) {
 						if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
@@ -2755,11 +3003,9 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
 						// by the basic H and V specified for the component
 						for (y = 0; y < z->img_comp[n].v; ++y) {
 							for (x = 0; x < z->img_comp[n].h; ++x) {
-								int x2 = (i*z->img_comp[n].h + x) * 8;
-								int y2 = (j*z->img_comp[n].v + y) * 8;
 								int ha = z->img_comp[n].ha;
-								if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-								z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2*y2 + x2, z->img_comp[n].w2, data);
+								if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, stbi__jpeg_block_dequant(z, n))) return 0;
+								stbi__jpeg_put_block(z, n, i*z->img_comp[n].h + x, j*z->img_comp[n].v + y, data);
 							}
 						}
 					}
@@ -2840,6 +3086,161 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
 	}
 }
 
+// decode MCUs [first, first + count) of a baseline scan, without restart handling
+static int stbi__jpeg_decode_mcus(stbi__jpeg *z, int first, int count)
+{
+	STBI_SIMD_ALIGN(short, data[64]);
+	int m;
+	if (z->scan_n == 1) {
+		int n = z->order[0];
+		int w = (z->img_comp[n].x + 7) >> 3;
+		int ha = z->img_comp[n].ha;
+		for (m = first; m < first + count; ++m) {
+			int i = m % w, j = m / w;
+			if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+			z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2*j * z->block_size + i * z->block_size, z->img_comp[n].w2, data);
+		}
+	}
+	else {
+		int k, x, y;
+		for (m = first; m < first + count; ++m) {
+			int i = m % z->img_mcu_x, j = m / z->img_mcu_x;
+			for (k = 0; k < z->scan_n; ++k) {
+				int n = z->order[k];
+				for (y = 0; y < z->img_comp[n].v; ++y) {
+					for (x = 0; x < z->img_comp[n].h; ++x) {
+						int x2 = (i*z->img_comp[n].h + x) * z->block_size;
+						int y2 = (j*z->img_comp[n].v + y) * z->block_size;
+						int ha = z->img_comp[n].ha;
+						if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+						z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2*y2 + x2, z->img_comp[n].w2, data);
+					}
+				}
+			}
+		}
+	}
+	return 1;
+}
+
+// at most this many tasks (each with its own copy of the decoder) share the restart segments of a scan
+#define STBI__RESTART_TASKS 64
+
+typedef struct
+{
+	stbi__jpeg *z;
+	stbi_uc **seg_start, **seg_end;
+	int nseg, per_task, total;
+	const char **failure; // one per task, NULL on success
+} stbi__jpeg_restart_job;
+
+static void stbi__jpeg_decode_restart_task(void *data, int task)
+{
+	stbi__jpeg_restart_job *job = (stbi__jpeg_restart_job *)data;
+	int seg = task * job->per_task;
+	int seg_end = seg + job->per_task < job->nseg ? seg + job->per_task : job->nseg;
+	stbi__context s;
+	stbi__jpeg *c = (stbi__jpeg *)stbi__malloc(sizeof(stbi__jpeg));
+	if (!c) {
+		job->failure[task] = "outofmem";
+		return;
+	}
+	// the huffman and quantization tables are read-only from here on, the
+	// component buffers are shared but every segment writes its own blocks
+	memcpy(c, job->z, sizeof(stbi__jpeg));
+	c->s = &s;
+	for (; seg < seg_end; ++seg) {
+		int first = seg * job->z->restart_interval;
+		int count = job->total - first < job->z->restart_interval ? job->total - first : job->z->restart_interval;
+		stbi__start_mem(&s, job->seg_start[seg], (int)(job->seg_end[seg] - job->seg_start[seg]));
+		stbi__jpeg_reset(c);
+		if (!stbi__jpeg_decode_mcus(c, first, count)) {
+			job->failure[task] = stbi__g_failure_reason ? stbi__g_failure_reason : "bad huffman code";
+			break;
+		}
+	}
+	STBI_FREE(c);
+}
+
+// Baseline scans with a restart interval, read from memory, are split at their RSTn markers
+// and the segments decoded concurrently. Returns -1 (having consumed nothing) when the scan
+// can't be split that way, in which case the caller decodes it serially.
+static int stbi__parse_entropy_coded_data_parallel(stbi__jpeg *z)
+{
+	stbi__jpeg_restart_job job;
+	stbi_uc *p, *end, *after;
+	int found = 0, marker = STBI__MARKER_none, ntasks, i;
+
+	if (z->progressive || z->coeff_only || !z->restart_interval || z->s->read_from_callbacks) return -1;
+	if (z->scan_n == 1) {
+		int n = z->order[0];
+		job.total = ((z->img_comp[n].x + 7) >> 3) * ((z->img_comp[n].y + 7) >> 3);
+	}
+	else {
+		job.total = z->img_mcu_x * z->img_mcu_y;
+	}
+	job.nseg = (job.total + z->restart_interval - 1) / z->restart_interval;
+	if (job.nseg < 2) return -1;
+	job.seg_start = (stbi_uc **)stbi__malloc_mad2(job.nseg, 2 * sizeof(stbi_uc *), 0);
+	if (!job.seg_start) return -1;
+	job.seg_end = job.seg_start + job.nseg;
+
+	// find the segments, matching how stbi__grow_buffer_unsafe reads markers
+	p = z->s->img_buffer;
+	end = z->s->img_buffer_end;
+	after = end;
+	job.seg_start[0] = p;
+	while (p < end) {
+		stbi_uc *q;
+		if (*p != 0xff) { ++p; continue; }
+		q = p + 1;
+		while (q < end && *q == 0xff) ++q;
+		if (q >= end || *q == 0) { p = q + 1; continue; }
+		if (found == job.nseg - 1 || !STBI__RESTART(*q)) {
+			// any other marker (or a surplus restart) ends the scan
+			job.seg_end[found++] = p;
+			marker = *q;
+			after = q + 1;
+			break;
+		}
+		job.seg_end[found++] = p;
+		job.seg_start[found] = p = q + 1;
+	}
+	if (p >= end) {
+		job.seg_end[found++] = end;
+	}
+	if (found != job.nseg || (marker != STBI__MARKER_none && STBI__RESTART(marker))) {
+		STBI_FREE(job.seg_start);
+		return -1;
+	}
+
+	job.z = z;
+	job.per_task = (job.nseg + STBI__RESTART_TASKS - 1) / STBI__RESTART_TASKS;
+	ntasks = (job.nseg + job.per_task - 1) / job.per_task;
+	job.failure = (const char **)stbi__malloc_mad2(ntasks, sizeof(const char *), 0);
+	if (!job.failure) {
+		STBI_FREE(job.seg_start);
+		return -1;
+	}
+	memset(job.failure, 0, ntasks * sizeof(const char *));
+	STBI_PARALLEL(ntasks, stbi__jpeg_decode_restart_task, &job);
+	for (i = 0; i < ntasks; ++i) {
+		if (job.failure[i]) {
+			const char *failure = job.failure[i];
+			STBI_FREE(job.failure);
+			STBI_FREE(job.seg_start);
+			return stbi__err(failure, "Corrupt JPEG");
+		}
+	}
+	STBI_FREE(job.failure);
+	STBI_FREE(job.seg_start);
+
+	// leave the stream just past the marker that ended the scan, as the serial decoder does
+	stbi__jpeg_reset(z);
+	z->s->img_buffer = after;
+	z->marker = (unsigned char)marker;
+	return 1;
+}
+
 static void stbi__jpeg_dequantize(short *data, stbi__uint16 *dequant)
 {
 	int i;
@@ -2859,7 +3260,7 @@ static void stbi__jpeg_finish(stbi__jpeg *z)
 				for (i = 0; i < w; ++i) {
 					short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
 					stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-					z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2*j * 8 + i * 8, z->img_comp[n].w2, data);
+					z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2*j * z->block_size + i * z->block_size, z->img_comp[n].w2, data);
 				}
 			}
 		}
@@ -3092,24 +3493,31 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
 		//
 		// img_mcu_x, img_mcu_y: <=17 bits; comp[i].h and .v are <=4 (checked earlier)
 		// so these muls can't overflow with 32-bit ints (which we require)
-		z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * 8;
-		z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * 8;
+		z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * z->block_size;
+		z->img_comp[i].h2 = (z->stream ? 2 : z->img_mcu_y) * z->img_comp[i].v * z->block_size;
 		z->img_comp[i].coeff = 0;
 		z->img_comp[i].raw_coeff = 0;
 		z->img_comp[i].linebuf = NULL;
-		z->img_comp[i].raw_data = stbi__malloc_mad2(z->img_comp[i].w2, z->img_comp[i].h2, 15);
-		if (z->img_comp[i].raw_data == NULL)
-			return stbi__free_jpeg_components(z, i + 1, stbi__err("outofmem", "Out of memory"));
-		// align blocks for idct using mmx/sse
-		z->img_comp[i].data = (stbi_uc*)(((size_t)z->img_comp[i].raw_data + 15) & ~15);
-		if (z->progressive) {
-			// w2, h2 are multiples of 8 (see above)
-			z->img_comp[i].coeff_w = z->img_comp[i].w2 / 8;
-			z->img_comp[i].coeff_h = z->img_comp[i].h2 / 8;
-			z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].w2, z->img_comp[i].h2, sizeof(short), 15);
+		z->img_comp[i].raw_data = NULL;
+		z->img_comp[i].data = NULL;
+		if (!z->coeff_only) {
+			z->img_comp[i].raw_data = stbi__malloc_mad2(z->img_comp[i].w2, z->img_comp[i].h2, 15);
+			if (z->img_comp[i].raw_data == NULL)
+				return stbi__free_jpeg_components(z, i + 1, stbi__err("outofmem", "Out of memory"));
+			// align blocks for idct using mmx/sse
+			z->img_comp[i].data = (stbi_uc*)(((size_t)z->img_comp[i].raw_data + 15) & ~15);
+		}
+		if (z->progressive || z->coeff_only) {
+			// one block per 8x8 pixels, whatever size the blocks are decoded at
+			z->img_comp[i].coeff_w = z->img_mcu_x * z->img_comp[i].h;
+			z->img_comp[i].coeff_h = z->img_mcu_y * z->img_comp[i].v;
+			z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].coeff_w * 8, z->img_comp[i].coeff_h * 8, sizeof(short), 15);
 			if (z->img_comp[i].raw_coeff == NULL)
 				return stbi__free_jpeg_components(z, i + 1, stbi__err("outofmem", "Out of memory"));
 			z->img_comp[i].coeff = (short*)(((size_t)z->img_comp[i].raw_coeff + 15) & ~15);
+			// blocks outside the scan (mcu padding) are never written
+			if (z->coeff_only)
+				memset(z->img_comp[i].coeff, 0, z->img_comp[i].coeff_w * z->img_comp[i].coeff_h * 64 * sizeof(short));
 		}
 	}
 
@@ -3162,8 +3570,11 @@ static int stbi__decode_jpeg_image(stbi__jpeg *j)
 	m = stbi__get_marker(j);
 	while (!stbi__EOI(m)) {
 		if (stbi__SOS(m)) {
+			int r;
 			if (!stbi__process_scan_header(j)) return 0;
-			if (!stbi__parse_entropy_coded_data(j)) return 0;
+			r = stbi__parse_entropy_coded_data_parallel(j);
+			if (r < 0) r = stbi__parse_entropy_coded_data(j);
+			if (!r) return 0;
 			if (j->marker == STBI__MARKER_none) {
 				// handle 0s at the end of image data from IP Kamera 9060
 				while (!stbi__at_eof(j->s)) {
@@ -3187,7 +3598,7 @@ static int stbi__decode_jpeg_image(stbi__jpeg *j)
 		}
 		m = stbi__get_marker(j);
 	}
-	if (j->progressive)
+	if (j->progressive && !j->coeff_only)
 		stbi__jpeg_finish(j);
 	return 1;
 }
@@ -3423,7 +3834,7 @@ static void stbi__YCbCr_to_RGB_row(stbi_uc *out, const stbi_uc *y, const stbi_uc
 		out[0] = (stbi_uc)r;
 		out[1] = (stbi_uc)g;
 		out[2] = (stbi_uc)b;
-		out[3] = 255;
+		if (step == 4) out[3] = 255; // don't touch the next row's first byte when step is 3
 		out += step;
 	}
 }
@@ -3557,7 +3968,7 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 		out[0] = (stbi_uc)r;
 		out[1] = (stbi_uc)g;
 		out[2] = (stbi_uc)b;
-		out[3] = 255;
+		if (step == 4) out[3] = 255; // don't touch the next row's first byte when step is 3
 		out += step;
 	}
 }
@@ -3566,6 +3977,9 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc *out, stbi_uc const *y, stbi_uc cons
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg *j)
 {
+	j->coeff_only = 0;
+	j->stream = 0;
+	j->block_size = 8;
 	j->idct_block_kernel = stbi__idct_block;
 	j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_row;
 	j->resample_row_hv_2_kernel = stbi__resample_row_hv_2;
@@ -3608,166 +4022,239 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
 	return (stbi_uc)((t + (t >> 8)) >> 8);
 }
 
-static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
+// output rows per resample/colour conversion task
+#define STBI__CONVERT_ROWS 32
+
+typedef struct
 {
+	stbi__jpeg *z;
+	stbi__resample res_comp[4]; // resampler state at the first row
+	stbi_uc *output;            // holds output rows [row_begin, row_end)
+	int row_begin, row_end;
+	int first_row[4];           // component row at the start of each component buffer
 	int n, decode_n, is_rgb;
-	z->s->img_n = 0; // make stbi__cleanup_jpeg safe
-
-					 // validate req_comp
-	if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
-
-	// load a jpeg image from whichever source, but leave in YCbCr format
-	if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
-
-	// determine actual number of components to generate
-	n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
-
-	is_rgb = z->s->img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
-
-	if (z->s->img_n == 3 && n < 3 && !is_rgb)
-		decode_n = 1;
-	else
-		decode_n = z->s->img_n;
-
-	// resample and color-convert
-	{
-		int k;
-		unsigned int i, j;
-		stbi_uc *output;
-		stbi_uc *coutput[4];
-
-		stbi__resample res_comp[4];
+} stbi__jpeg_convert_job;
+
+// move a resampler from the first row to output row 'row', in one go; 'first' is the
+// component row its line pointers start at
+static void stbi__resample_seek(stbi__resample *r, int row, int comp_y, int w2, int first)
+{
+	int steps = r->ystep + row;
+	int adv = steps / r->vs;
+	r->ystep = steps % r->vs;
+	r->ypos = adv;
+	if (adv > 0) {
+		r->line0 += w2 * ((adv - 1 < comp_y - 1 ? adv - 1 : comp_y - 1) - first);
+		r->line1 += w2 * ((adv < comp_y - 1 ? adv : comp_y - 1) - first);
+	}
+}
+
+// resample and colour convert output rows [row_begin + task * STBI__CONVERT_ROWS, ...),
+// each task working on its own slice of the component line buffers
+static void stbi__jpeg_convert_rows(void *data, int task)
+{
+	stbi__jpeg_convert_job *job = (stbi__jpeg_convert_job *)data;
+	stbi__jpeg *z = job->z;
+	stbi_uc *output = job->output;
+	int n = job->n, decode_n = job->decode_n, is_rgb = job->is_rgb;
+	unsigned int i, j;
+	unsigned int j0 = job->row_begin + task * STBI__CONVERT_ROWS;
+	unsigned int j1 = j0 + STBI__CONVERT_ROWS < (unsigned int)job->row_end ? j0 + STBI__CONVERT_ROWS : (unsigned int)job->row_end;
+	stbi_uc *coutput[4];
+	stbi__resample res_comp[4];
+	int k;
 
+	for (k = 0; k < decode_n; ++k) {
+		res_comp[k] = job->res_comp[k];
+		stbi__resample_seek(&res_comp[k], j0, z->img_comp[k].y, z->img_comp[k].w2, job->first_row[k]);
+	}
+	for (j = j0; j < j1; ++j) {
+		stbi_uc *out = output + (size_t)n * z->s->img_x * (j - job->row_begin);
 		for (k = 0; k < decode_n; ++k) {
 			stbi__resample *r = &res_comp[k];
-
-			// allocate line buffer big enough for upsampling off the edges
-			// with upsample factor of 4
-			z->img_comp[k].linebuf = (stbi_uc *)stbi__malloc(z->s->img_x + 3);
-			if (!z->img_comp[k].linebuf) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
-
-			r->hs = z->img_h_max / z->img_comp[k].h;
-			r->vs = z->img_v_max / z->img_comp[k].v;
-			r->ystep = r->vs >> 1;
-			r->w_lores = (z->s->img_x + r->hs - 1) / r->hs;
-			r->ypos = 0;
-			r->line0 = r->line1 = z->img_comp[k].data;
-
-			if (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
-			else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
-			else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
-			else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
-			else                               r->resample = stbi__resample_row_generic;
-		}
-
-		// can't error after this so, this is safe
-		output = (stbi_uc *)stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
-		if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
-
-		// now go ahead and resample
-		for (j = 0; j < z->s->img_y; ++j) {
-			stbi_uc *out = output + n * z->s->img_x * j;
-			for (k = 0; k < decode_n; ++k) {
-				stbi__resample *r = &res_comp[k];
-				int y_bot = r->ystep >= (r->vs >> 1);
-				coutput[k] = r->resample(z->img_comp[k].linebuf,
-					y_bot ? r->line1 : r->line0,
-					y_bot ? r->line0 : r->line1,
-					r->w_lores, r->hs);
-				if (++r->ystep >= r->vs) {
-					r->ystep = 0;
-					r->line0 = r->line1;
-					if (++r->ypos < z->img_comp[k].y)
-						r->line1 += z->img_comp[k].w2;
-				}
+			int y_bot = r->ystep >= (r->vs >> 1);
+			coutput[k] = r->resample(z->img_comp[k].linebuf + (size_t)task * (z->s->img_x + 3),
+				y_bot ? r->line1 : r->line0,
+				y_bot ? r->line0 : r->line1,
+				r->w_lores, r->hs);
+			if (++r->ystep >= r->vs) {
+				r->ystep = 0;
+				r->line0 = r->line1;
+				if (++r->ypos < z->img_comp[k].y)
+					r->line1 += z->img_comp[k].w2;
 			}
-			if (n >= 3) {
-				stbi_uc *y = coutput[0];
-				if (z->s->img_n == 3) {
-					if (is_rgb) {
-						for (i = 0; i < z->s->img_x; ++i) {
-							out[0] = y[i];
-							out[1] = coutput[1][i];
-							out[2] = coutput[2][i];
-							out[3] = 255;
-							out += n;
-						}
-					}
-					else {
-						z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+		}
+		if (n >= 3) {
+			stbi_uc *y = coutput[0];
+			if (z->s->img_n == 3) {
+				if (is_rgb) {
+					for (i = 0; i < z->s->img_x; ++i) {
+						out[0] = y[i];
+						out[1] = coutput[1][i];
+						out[2] = coutput[2][i];
+						if (n == 4) out[3] = 255;
+						out += n;
 					}
 				}
-				else if (z->s->img_n == 4) {
-					if (z->app14_color_transform == 0) { // CMYK
-						for (i = 0; i < z->s->img_x; ++i) {
-							stbi_uc m = coutput[3][i];
-							out[0] = stbi__blinn_8x8(coutput[0][i], m);
-							out[1] = stbi__blinn_8x8(coutput[1][i], m);
-							out[2] = stbi__blinn_8x8(coutput[2][i], m);
-							out[3] = 255;
-							out += n;
-						}
-					}
-					else if (z->app14_color_transform == 2) { // YCCK
-						z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-						for (i = 0; i < z->s->img_x; ++i) {
-							stbi_uc m = coutput[3][i];
-							out[0] = stbi__blinn_8x8(255 - out[0], m);
-							out[1] = stbi__blinn_8x8(255 - out[1], m);
-							out[2] = stbi__blinn_8x8(255 - out[2], m);
-							out += n;
-						}
-					}
-					else { // YCbCr + alpha?  Ignore the fourth channel for now
-						z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-					}
+				else {
+					z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
 				}
-				else
+			}
+			else if (z->s->img_n == 4) {
+				if (z->app14_color_transform == 0) { // CMYK
 					for (i = 0; i < z->s->img_x; ++i) {
-						out[0] = out[1] = out[2] = y[i];
-						out[3] = 255; // not used if n==3
+						stbi_uc m = coutput[3][i];
+						out[0] = stbi__blinn_8x8(coutput[0][i], m);
+						out[1] = stbi__blinn_8x8(coutput[1][i], m);
+						out[2] = stbi__blinn_8x8(coutput[2][i], m);
+						if (n == 4) out[3] = 255;
 						out += n;
 					}
-			}
-			else {
-				if (is_rgb) {
-					if (n == 1)
-						for (i = 0; i < z->s->img_x; ++i)
-							*out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-					else {
-						for (i = 0; i < z->s->img_x; ++i, out += 2) {
-							out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-							out[1] = 255;
-						}
-					}
 				}
-				else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+				else if (z->app14_color_transform == 2) { // YCCK
+					z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
 					for (i = 0; i < z->s->img_x; ++i) {
 						stbi_uc m = coutput[3][i];
-						stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
-						stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
-						stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
-						out[0] = stbi__compute_y(r, g, b);
-						out[1] = 255;
+						out[0] = stbi__blinn_8x8(255 - out[0], m);
+						out[1] = stbi__blinn_8x8(255 - out[1], m);
+						out[2] = stbi__blinn_8x8(255 - out[2], m);
 						out += n;
 					}
 				}
-				else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
-					for (i = 0; i < z->s->img_x; ++i) {
-						out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+				else { // YCbCr + alpha?  Ignore the fourth channel for now
+					z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+				}
+			}
+			else
+				for (i = 0; i < z->s->img_x; ++i) {
+					out[0] = out[1] = out[2] = y[i];
+					if (n == 4) out[3] = 255; // stay within the row, rows are converted concurrently
+					out += n;
+				}
+		}
+		else {
+			if (is_rgb) {
+				if (n == 1)
+					for (i = 0; i < z->s->img_x; ++i)
+						*out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+				else {
+					for (i = 0; i < z->s->img_x; ++i, out += 2) {
+						out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
 						out[1] = 255;
-						out += n;
 					}
 				}
-				else {
-					stbi_uc *y = coutput[0];
-					if (n == 1)
-						for (i = 0; i < z->s->img_x; ++i) out[i] = y[i];
-					else
-						for (i = 0; i < z->s->img_x; ++i) *out++ = y[i], *out++ = 255;
+			}
+			else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+				for (i = 0; i < z->s->img_x; ++i) {
+					stbi_uc m = coutput[3][i];
+					stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
+					stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
+					stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
+					out[0] = stbi__compute_y(r, g, b);
+					out[1] = 255;
+					out += n;
+				}
+			}
+			else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+				for (i = 0; i < z->s->img_x; ++i) {
+					out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+					out[1] = 255;
+					out += n;
 				}
 			}
+			else {
+				stbi_uc *y = coutput[0];
+				if (n == 1)
+					for (i = 0; i < z->s->img_x; ++i) out[i] = y[i];
+				else
+					for (i = 0; i < z->s->img_x; ++i) *out++ = y[i], *out++ = 255;
+			}
+		}
+	}
+}
+
+// set up the resamplers (and line buffers for ntasks concurrent tasks) that turn the
+// decoded components into n-channel output rows
+static int stbi__jpeg_setup_convert(stbi__jpeg *z, stbi__jpeg_convert_job *job, int n, int ntasks)
+{
+	int k;
+
+	job->z = z;
+	job->n = n;
+	job->is_rgb = z->s->img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
+
+	if (z->s->img_n == 3 && n < 3 && !job->is_rgb)
+		job->decode_n = 1;
+	else
+		job->decode_n = z->s->img_n;
+
+	for (k = 0; k < job->decode_n; ++k) {
+		stbi__resample *r = &job->res_comp[k];
+
+		// allocate line buffers (one per task) big enough for upsampling off the edges
+		// with upsample factor of 4
+		z->img_comp[k].linebuf = (stbi_uc *)stbi__malloc_mad2(ntasks, z->s->img_x + 3, 0);
+		if (!z->img_comp[k].linebuf) return 0;
+
+		r->hs = z->img_h_max / z->img_comp[k].h;
+		r->vs = z->img_v_max / z->img_comp[k].v;
+		r->ystep = r->vs >> 1;
+		r->w_lores = (z->s->img_x + r->hs - 1) / r->hs;
+		r->ypos = 0;
+		r->line0 = r->line1 = z->img_comp[k].data;
+
+		if (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
+		else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
+		else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
+		else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
+		else                               r->resample = stbi__resample_row_generic;
+
+		job->first_row[k] = 0;
+	}
+	return 1;
+}
+
+static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
+{
+	int n;
+	z->s->img_n = 0; // make stbi__cleanup_jpeg safe
+
+					 // validate req_comp
+	if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
+
+	// load a jpeg image from whichever source, but leave in YCbCr format
+	if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
+
+	// a scaled decode left smaller blocks behind, the image shrinks with them
+	if (z->block_size < 8) {
+		z->s->img_x = (z->s->img_x * z->block_size + 7) / 8;
+		z->s->img_y = (z->s->img_y * z->block_size + 7) / 8;
+		for (n = 0; n < z->s->img_n; ++n) {
+			z->img_comp[n].x = (z->img_comp[n].x * z->block_size + 7) / 8;
+			z->img_comp[n].y = (z->img_comp[n].y * z->block_size + 7) / 8;
 		}
+	}
+
+	// determine actual number of components to generate
+	n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
+
+	// resample and color-convert
+	{
+		int ntasks = (z->s->img_y + STBI__CONVERT_ROWS - 1) / STBI__CONVERT_ROWS;
+		stbi_uc *output;
+		stbi__jpeg_convert_job job;
+
+		if (!stbi__jpeg_setup_convert(z, &job, n, ntasks)) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+
+		// can't error after this so, this is safe
+		output = (stbi_uc *)stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
+		if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+
+		// now go ahead and resample, a strip of rows at a time
+		job.output = output;
+		job.row_begin = 0;
+		job.row_end = z->s->img_y;
+		STBI_PARALLEL(ntasks, stbi__jpeg_convert_rows, &job);
 		stbi__cleanup_jpeg(z);
 		*out_x = z->s->img_x;
 		*out_y = z->s->img_y;
@@ -3780,10 +4267,144 @@ static void *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int re
 {
 	unsigned char* result;
 	stbi__jpeg* j = (stbi__jpeg*)stbi__malloc(sizeof(stbi__jpeg));
-	STBI_NOTUSED(ri);
 	j->s = s;
 	stbi__setup_jpeg(j);
+	if (s->scale > 1) {
+		j->block_size = 8 / s->scale;
+		j->idct_block_kernel = s->scale == 2 ? stbi__idct_block_4 : s->scale == 4 ? stbi__idct_block_2 : stbi__idct_block_1;
+	}
 	result = load_jpeg_image(j, x, y, comp, req_comp);
+	if (result) ri->scale = s->scale;
+	STBI_FREE(j);
+	return result;
+}
+
+// Decode a baseline JPEG one MCU row (a block row for a single component) at a time into
+// component buffers two MCU rows high, and hand each band to func as soon as it is colour
+// converted. Upsampling an output row reads the component row below it, so every band but
+// the last stops up to vs/2 rows short of its MCU row. Returns -1, before anything went to
+// func, when the image is progressive or its first scan doesn't hold every component.
+static int stbi__jpeg_stream_rows(stbi__jpeg *z, int req_comp, stbi_band_func *func, void *user)
+{
+	STBI_SIMD_ALIGN(short, data[64]);
+	stbi__jpeg_convert_job job;
+	stbi_uc *band;
+	int rows[4];   // component rows decoded per band
+	int n, m, k, b, i, x, y, nbands, band_h, lag = 0, top = 0, done = 0, corrupt = 0, ok = 1;
+
+	for (m = 0; m < 4; m++) {
+		z->img_comp[m].raw_data = NULL;
+		z->img_comp[m].raw_coeff = NULL;
+	}
+	z->s->img_n = 0; // make stbi__cleanup_jpeg safe
+	z->restart_interval = 0;
+	z->stream = 1;
+	if (!stbi__decode_jpeg_header(z, STBI__SCAN_load)) { stbi__cleanup_jpeg(z); return 0; }
+	if (z->progressive) { stbi__cleanup_jpeg(z); return -1; }
+	m = stbi__get_marker(z);
+	while (!stbi__SOS(m)) {
+		if (stbi__EOI(m)) { stbi__cleanup_jpeg(z); return stbi__err("no SOS", "Corrupt JPEG"); }
+		if (!stbi__process_marker(z, m)) { stbi__cleanup_jpeg(z); return 0; }
+		m = stbi__get_marker(z);
+	}
+	if (!stbi__process_scan_header(z)) { stbi__cleanup_jpeg(z); return 0; }
+	if (z->scan_n != z->s->img_n) { stbi__cleanup_jpeg(z); return -1; }
+
+	if (z->scan_n == 1) {
+		// a lone component is coded in raster order of its own blocks
+		nbands = (z->img_comp[z->order[0]].y + 7) >> 3;
+		band_h = 8;
+		rows[0] = 8;
+	}
+	else {
+		nbands = z->img_mcu_y;
+		band_h = z->img_mcu_h;
+		for (k = 0; k < z->s->img_n; ++k)
+			rows[k] = z->img_comp[k].v * 8;
+	}
+
+	n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
+	if (!stbi__jpeg_setup_convert(z, &job, n, (band_h + 2 + STBI__CONVERT_ROWS - 1) / STBI__CONVERT_ROWS)) {
+		stbi__cleanup_jpeg(z);
+		return stbi__err("outofmem", "Out of memory");
+	}
+	for (k = 0; k < job.decode_n; ++k)
+		if (job.res_comp[k].vs >> 1 > lag) lag = job.res_comp[k].vs >> 1;
+	band = (stbi_uc *)stbi__malloc_mad3(n, z->s->img_x, band_h + lag, 0);
+	if (!band) { stbi__cleanup_jpeg(z); return stbi__err("outofmem", "Out of memory"); }
+	job.output = band;
+
+	stbi__jpeg_reset(z);
+	for (b = 0; b < nbands && ok; ++b) {
+		int slot, limit;
+		if (b >= 2) {
+			// slide the window down, keeping the previous MCU row for upsampling
+			for (k = 0; k < z->s->img_n; ++k)
+				memmove(z->img_comp[k].data, z->img_comp[k].data + z->img_comp[k].w2 * rows[k], z->img_comp[k].w2 * rows[k]);
+			top = b - 1;
+		}
+		slot = b - top;
+		if (z->scan_n == 1) {
+			int c = z->order[0], ha = z->img_comp[c].ha;
+			int w = (z->img_comp[c].x + 7) >> 3;
+			for (i = 0; i < w && ok && !corrupt; ++i) {
+				ok = stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[c].hd, z->huff_ac + ha, z->fast_ac[ha], c, z->dequant[z->img_comp[c].tq]);
+				if (!ok) break;
+				stbi__jpeg_put_block(z, c, i, slot, data);
+				if (--z->todo <= 0) {
+					if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+					// as in stbi__parse_entropy_coded_data, corrupt data rather than no data
+					if (!STBI__RESTART(z->marker)) corrupt = 1;
+					else stbi__jpeg_reset(z);
+				}
+			}
+		}
+		else {
+			for (i = 0; i < z->img_mcu_x && ok && !corrupt; ++i) {
+				for (k = 0; k < z->scan_n && ok; ++k) {
+					int c = z->order[k], ha = z->img_comp[c].ha;
+					for (y = 0; y < z->img_comp[c].v && ok; ++y) {
+						for (x = 0; x < z->img_comp[c].h; ++x) {
+							ok = stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[c].hd, z->huff_ac + ha, z->fast_ac[ha], c, z->dequant[z->img_comp[c].tq]);
+							if (!ok) break;
+							stbi__jpeg_put_block(z, c, i * z->img_comp[c].h + x, slot * z->img_comp[c].v + y, data);
+						}
+					}
+				}
+				if (ok && --z->todo <= 0) {
+					if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+					if (!STBI__RESTART(z->marker)) corrupt = 1;
+					else stbi__jpeg_reset(z);
+				}
+			}
+		}
+		if (!ok) break;
+
+		limit = b == nbands - 1 ? (int)z->s->img_y : (b + 1) * band_h - lag;
+		if (limit > (int)z->s->img_y) limit = z->s->img_y;
+		if (limit > done) {
+			job.row_begin = done;
+			job.row_end = limit;
+			for (k = 0; k < job.decode_n; ++k)
+				job.first_row[k] = top * rows[k];
+			STBI_PARALLEL((limit - done + STBI__CONVERT_ROWS - 1) / STBI__CONVERT_ROWS, stbi__jpeg_convert_rows, &job);
+			ok = func(user, band, done, limit - done, z->s->img_x, z->s->img_y);
+			done = limit;
+		}
+	}
+	STBI_FREE(band);
+	stbi__cleanup_jpeg(z);
+	return ok;
+}
+
+static int stbi__jpeg_load_bands(stbi__context *s, int req_comp, stbi_band_func *func, void *user)
+{
+	int result;
+	stbi__jpeg* j = (stbi__jpeg*)stbi__malloc(sizeof(stbi__jpeg));
+	if (!j) return stbi__err("outofmem", "Out of memory");
+	j->s = s;
+	stbi__setup_jpeg(j);
+	result = stbi__jpeg_stream_rows(j, req_comp, func, user);
 	STBI_FREE(j);
 	return result;
 }
@@ -3821,6 +4442,68 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 	STBI_FREE(j);
 	return result;
 }
+
+STBIDEF int stbi_jpeg_load_coefficients_from_memory(stbi_uc const *buffer, int len, stbi_jpeg_coefficients *out)
+{
+	stbi__context s;
+	stbi__jpeg *j;
+	int i, n, ok = 0;
+
+	memset(out, 0, sizeof(*out));
+	stbi__start_mem(&s, buffer, len);
+	j = (stbi__jpeg *)stbi__malloc(sizeof(stbi__jpeg));
+	if (!j) return stbi__err("outofmem", "Out of memory");
+	j->s = &s;
+	stbi__setup_jpeg(j);
+	j->coeff_only = 1;
+	for (i = 0; i < 4; ++i) {
+		j->img_comp[i].raw_data = NULL;
+		j->img_comp[i].raw_coeff = NULL;
+		j->img_comp[i].linebuf = NULL;
+	}
+	if (stbi__decode_jpeg_image(j)) {
+		n = s.img_n;
+		if (n == 4) {
+			stbi__err("cmyk", "JPEG format not supported: CMYK coefficients");
+		}
+		else {
+			out->x = s.img_x;
+			out->y = s.img_y;
+			out->n = n;
+			out->is_rgb = n == 3 && (j->rgb == 3 || (j->app14_color_transform == 0 && !j->jfif));
+			out->h_max = j->img_h_max;
+			out->v_max = j->img_v_max;
+			memcpy(out->quant, j->dequant, sizeof(out->quant));
+			for (i = 0; i < n; ++i) {
+				out->comp[i].id = j->img_comp[i].id;
+				out->comp[i].h = j->img_comp[i].h;
+				out->comp[i].v = j->img_comp[i].v;
+				out->comp[i].tq = j->img_comp[i].tq;
+				out->comp[i].blocks_w = j->img_comp[i].coeff_w;
+				out->comp[i].blocks_h = j->img_comp[i].coeff_h;
+				out->comp[i].coeff = j->img_comp[i].coeff;
+				out->comp[i].raw_coeff = j->img_comp[i].raw_coeff;
+				// ownership moves to the caller
+				j->img_comp[i].raw_coeff = NULL;
+				j->img_comp[i].coeff = NULL;
+			}
+			ok = 1;
+		}
+	}
+	stbi__free_jpeg_components(j, 4, 0);
+	STBI_FREE(j);
+	return ok;
+}
+
+STBIDEF void stbi_jpeg_free_coefficients(stbi_jpeg_coefficients *c)
+{
+	int i;
+	for (i = 0; i < 4; ++i) {
+		STBI_FREE(c->comp[i].raw_coeff);
+		c->comp[i].raw_coeff = NULL;
+		c->comp[i].coeff = NULL;
+	}
+}
 #endif
 
 // public domain zlib decode    v0.2  Sean Barrett 2006-11-18
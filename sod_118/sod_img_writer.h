@@ -64,6 +64,34 @@ int stbi_write_tga(char const *filename, int w, int h, int comp, const void *dat
 int stbi_write_jpg(char const *filename, int w, int h, int comp, const void *data, int quality);
 int stbi_write_hdr(char const *filename, int w, int h, int comp, const float *data);
 
+stbi_write_jpg_ext() takes two extra JPEG encoder settings:
+
+int stbi_write_jpg_ext(char const *filename, int w, int h, int comp, const void *data, int quality, int subsample, int buffered, int restart_rows);
+
+subsample: non-zero to store the chroma planes at half resolution (4:2:0) instead of full resolution (4:4:4).
+buffered: non-zero to stage the entropy coded bytes in a block buffer instead of handing them to
+the write callback one at a time. The output is byte for byte the same, only faster to produce.
+restart_rows: when positive, the scan is cut into strips of that many MCU rows separated by
+restart markers (DRI/RSTn). Strips are coded independently, in parallel if STBIW_PARALLEL is defined.
+
+stbi_write_jpg_coefficients() writes a baseline JPEG straight from quantized DCT coefficients,
+e.g. the blocks of a decoded JPEG after a lossless rotate/flip, so nothing goes through the DCT:
+
+int stbi_write_jpg_coefficients(char const *filename, int w, int h, int comp, const stbi_write_jpg_component *comps, const unsigned short quant[4][64]);
+
+comp is 1 (grayscale) or 3 (YCbCr); quant holds the quantization tables in natural order,
+selected per component by comps[i].tq. Coefficients are coded with the standard Huffman tables.
+
+A JPEG can also be written a band of rows at a time, so the whole image never has to be in memory:
+
+stbi_write_jpg_stream *stbi_write_jpg_stream_begin(char const *filename, int w, int h, int comp, int quality, int subsample, int buffered);
+int stbi_write_jpg_stream_rows(stbi_write_jpg_stream *st, const void *rows, int nrows);
+int stbi_write_jpg_stream_end(stbi_write_jpg_stream *st);
+
+Rows go top to bottom in bands of any height; only a partly filled MCU row (8 or 16 rows) is
+buffered. stream_end closes the file and fails if fewer than h rows were written. The output is
+the same as stbi_write_jpg_ext() without restart markers; stbi_flip_vertically_on_write does not apply.
+
 void stbi_flip_vertically_on_write(int flag); // flag is non-zero to flip data vertically
 
 There are also five equivalent functions that use an arbitrary write function. You are
@@ -189,6 +217,26 @@ STBIWDEF int stbi_write_bmp(char const *filename, int w, int h, int comp, const
 STBIWDEF int stbi_write_tga(char const *filename, int w, int h, int comp, const void  *data);
 STBIWDEF int stbi_write_hdr(char const *filename, int w, int h, int comp, const float *data);
 STBIWDEF int stbi_write_jpg(char const *filename, int x, int y, int comp, const void  *data, int quality);
+STBIWDEF int stbi_write_jpg_ext(char const *filename, int x, int y, int comp, const void  *data, int quality, int subsample, int buffered, int restart_rows);
+#endif
+
+typedef struct
+{
+	int id, h, v, tq;       // component id, sampling factors, quantization table
+	int blocks_w;           // row stride of coeff, in 8x8 blocks
+	const short *coeff;     // 64 quantized coefficients per block, natural order
+} stbi_write_jpg_component;
+
+#ifndef STBI_WRITE_NO_STDIO
+STBIWDEF int stbi_write_jpg_coefficients(char const *filename, int x, int y, int comp, const stbi_write_jpg_component *comps, const unsigned short quant[4][64]);
+#endif
+
+typedef struct stbi_write_jpg_stream stbi_write_jpg_stream;
+
+#ifndef STBI_WRITE_NO_STDIO
+STBIWDEF stbi_write_jpg_stream *stbi_write_jpg_stream_begin(char const *filename, int x, int y, int comp, int quality, int subsample, int buffered);
+STBIWDEF int stbi_write_jpg_stream_rows(stbi_write_jpg_stream *st, const void *rows, int nrows);
+STBIWDEF int stbi_write_jpg_stream_end(stbi_write_jpg_stream *st);
 #endif
 
 typedef void stbi_write_func(void *context, void *data, int size);
@@ -246,6 +294,12 @@ STBIWDEF void stbi_flip_vertically_on_write(int flip_boolean);
 #define STBIW_MEMMOVE(a,b,sz) memmove(a,b,sz)
 #endif
 
+// You can #define STBIW_PARALLEL(n,task,data) to run task(data, i) for i in [0, n) on several
+// threads (returning once they are all done); JPEG restart strips are then coded concurrently.
+#ifndef STBIW_PARALLEL
+#define STBIW_PARALLEL(n,task,data) do { int stbiw__t; for (stbiw__t = 0; stbiw__t < (n); ++stbiw__t) (task)((data), stbiw__t); } while (0)
+#endif
+
 
 #ifndef STBIW_ASSERT
 #include <assert.h>
@@ -1177,21 +1231,56 @@ STBIWDEF int stbi_write_png_to_func(stbi_write_func *func, void *context, int x,
 static const unsigned char stbiw__jpg_ZigZag[] = { 0,1,5,6,14,15,27,28,2,4,7,13,16,26,29,42,3,8,12,17,25,30,41,43,9,11,18,
 24,31,40,44,53,10,19,23,32,39,45,52,54,20,22,33,38,46,51,55,60,21,34,37,47,50,56,59,61,35,36,48,49,57,58,62,63 };
 
-static void stbiw__jpg_writeBits(stbi__write_context *s, int *bitBufP, int *bitCntP, const unsigned short *bs) {
-	int bitBuf = *bitBufP, bitCnt = *bitCntP;
+// Entropy coder output state. With a staging buffer (buffered output) the coded bytes
+// are handed to the write callback a block at a time instead of one by one.
+#define STBIW__JPG_OUT_SIZE 4096
+typedef struct
+{
+	stbi__write_context *s;
+	int bitBuf, bitCnt;
+	unsigned char *out;
+	int outLen;
+} stbiw__jpg_bits;
+
+static void stbiw__jpg_flushOut(stbiw__jpg_bits *b) {
+	if (b->outLen) {
+		b->s->func(b->s->context, b->out, b->outLen);
+		b->outLen = 0;
+	}
+}
+
+static void stbiw__jpg_writeBits(stbiw__jpg_bits *b, const unsigned short *bs) {
+	int bitBuf = b->bitBuf, bitCnt = b->bitCnt;
 	bitCnt += bs[1];
 	bitBuf |= bs[0] << (24 - bitCnt);
-	while (bitCnt >= 8) {
-		unsigned char c = (bitBuf >> 16) & 255;
-		stbiw__putc(s, c);
-		if (c == 255) {
-			stbiw__putc(s, 0);
+	if (b->out) {
+		// At most 2 bytes (4 once stuffed) are produced per call
+		if (b->outLen > STBIW__JPG_OUT_SIZE - 4) {
+			stbiw__jpg_flushOut(b);
+		}
+		while (bitCnt >= 8) {
+			unsigned char c = (bitBuf >> 16) & 255;
+			b->out[b->outLen++] = c;
+			if (c == 255) {
+				b->out[b->outLen++] = 0;
+			}
+			bitBuf <<= 8;
+			bitCnt -= 8;
 		}
-		bitBuf <<= 8;
-		bitCnt -= 8;
 	}
-	*bitBufP = bitBuf;
-	*bitCntP = bitCnt;
+	else {
+		while (bitCnt >= 8) {
+			unsigned char c = (bitBuf >> 16) & 255;
+			stbiw__putc(b->s, c);
+			if (c == 255) {
+				stbiw__putc(b->s, 0);
+			}
+			bitBuf <<= 8;
+			bitCnt -= 8;
+		}
+	}
+	b->bitBuf = bitBuf;
+	b->bitCnt = bitCnt;
 }
 
 static void stbiw__jpg_DCT(float *d0p, float *d1p, float *d2p, float *d3p, float *d4p, float *d5p, float *d6p, float *d7p) {
@@ -1242,6 +1331,87 @@ static void stbiw__jpg_DCT(float *d0p, float *d1p, float *d2p, float *d3p, float
 	*d0p = d0;  *d2p = d2;  *d4p = d4;  *d6p = d6;
 }
 
+// Standard Huffman tables (ITU T.81 annex K.3)
+static const unsigned char stbiw__jpg_dc_luminance_nrcodes[] = { 0,0,1,5,1,1,1,1,1,1,0,0,0,0,0,0,0 };
+static const unsigned char stbiw__jpg_dc_luminance_values[] = { 0,1,2,3,4,5,6,7,8,9,10,11 };
+static const unsigned char stbiw__jpg_ac_luminance_nrcodes[] = { 0,0,2,1,3,3,2,4,3,5,5,4,4,0,0,1,0x7d };
+static const unsigned char stbiw__jpg_ac_luminance_values[] = {
+	0x01,0x02,0x03,0x00,0x04,0x11,0x05,0x12,0x21,0x31,0x41,0x06,0x13,0x51,0x61,0x07,0x22,0x71,0x14,0x32,0x81,0x91,0xa1,0x08,
+	0x23,0x42,0xb1,0xc1,0x15,0x52,0xd1,0xf0,0x24,0x33,0x62,0x72,0x82,0x09,0x0a,0x16,0x17,0x18,0x19,0x1a,0x25,0x26,0x27,0x28,
+	0x29,0x2a,0x34,0x35,0x36,0x37,0x38,0x39,0x3a,0x43,0x44,0x45,0x46,0x47,0x48,0x49,0x4a,0x53,0x54,0x55,0x56,0x57,0x58,0x59,
+	0x5a,0x63,0x64,0x65,0x66,0x67,0x68,0x69,0x6a,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7a,0x83,0x84,0x85,0x86,0x87,0x88,0x89,
+	0x8a,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9a,0xa2,0xa3,0xa4,0xa5,0xa6,0xa7,0xa8,0xa9,0xaa,0xb2,0xb3,0xb4,0xb5,0xb6,
+	0xb7,0xb8,0xb9,0xba,0xc2,0xc3,0xc4,0xc5,0xc6,0xc7,0xc8,0xc9,0xca,0xd2,0xd3,0xd4,0xd5,0xd6,0xd7,0xd8,0xd9,0xda,0xe1,0xe2,
+	0xe3,0xe4,0xe5,0xe6,0xe7,0xe8,0xe9,0xea,0xf1,0xf2,0xf3,0xf4,0xf5,0xf6,0xf7,0xf8,0xf9,0xfa
+};
+static const unsigned char stbiw__jpg_dc_chrominance_nrcodes[] = { 0,0,3,1,1,1,1,1,1,1,1,1,0,0,0,0,0 };
+static const unsigned char stbiw__jpg_dc_chrominance_values[] = { 0,1,2,3,4,5,6,7,8,9,10,11 };
+static const unsigned char stbiw__jpg_ac_chrominance_nrcodes[] = { 0,0,2,1,2,4,4,3,4,7,5,4,4,0,1,2,0x77 };
+static const unsigned char stbiw__jpg_ac_chrominance_values[] = {
+	0x00,0x01,0x02,0x03,0x11,0x04,0x05,0x21,0x31,0x06,0x12,0x41,0x51,0x07,0x61,0x71,0x13,0x22,0x32,0x81,0x08,0x14,0x42,0x91,
+	0xa1,0xb1,0xc1,0x09,0x23,0x33,0x52,0xf0,0x15,0x62,0x72,0xd1,0x0a,0x16,0x24,0x34,0xe1,0x25,0xf1,0x17,0x18,0x19,0x1a,0x26,
+	0x27,0x28,0x29,0x2a,0x35,0x36,0x37,0x38,0x39,0x3a,0x43,0x44,0x45,0x46,0x47,0x48,0x49,0x4a,0x53,0x54,0x55,0x56,0x57,0x58,
+	0x59,0x5a,0x63,0x64,0x65,0x66,0x67,0x68,0x69,0x6a,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7a,0x82,0x83,0x84,0x85,0x86,0x87,
+	0x88,0x89,0x8a,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9a,0xa2,0xa3,0xa4,0xa5,0xa6,0xa7,0xa8,0xa9,0xaa,0xb2,0xb3,0xb4,
+	0xb5,0xb6,0xb7,0xb8,0xb9,0xba,0xc2,0xc3,0xc4,0xc5,0xc6,0xc7,0xc8,0xc9,0xca,0xd2,0xd3,0xd4,0xd5,0xd6,0xd7,0xd8,0xd9,0xda,
+	0xe2,0xe3,0xe4,0xe5,0xe6,0xe7,0xe8,0xe9,0xea,0xf2,0xf3,0xf4,0xf5,0xf6,0xf7,0xf8,0xf9,0xfa
+};
+// Huffman tables
+static const unsigned short stbiw__jpg_YDC_HT[256][2] = { { 0,2 },{ 2,3 },{ 3,3 },{ 4,3 },{ 5,3 },{ 6,3 },{ 14,4 },{ 30,5 },{ 62,6 },{ 126,7 },{ 254,8 },{ 510,9 } };
+static const unsigned short stbiw__jpg_UVDC_HT[256][2] = { { 0,2 },{ 1,2 },{ 2,2 },{ 6,3 },{ 14,4 },{ 30,5 },{ 62,6 },{ 126,7 },{ 254,8 },{ 510,9 },{ 1022,10 },{ 2046,11 } };
+static const unsigned short stbiw__jpg_YAC_HT[256][2] = {
+	{ 10,4 },{ 0,2 },{ 1,2 },{ 4,3 },{ 11,4 },{ 26,5 },{ 120,7 },{ 248,8 },{ 1014,10 },{ 65410,16 },{ 65411,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 12,4 },{ 27,5 },{ 121,7 },{ 502,9 },{ 2038,11 },{ 65412,16 },{ 65413,16 },{ 65414,16 },{ 65415,16 },{ 65416,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 28,5 },{ 249,8 },{ 1015,10 },{ 4084,12 },{ 65417,16 },{ 65418,16 },{ 65419,16 },{ 65420,16 },{ 65421,16 },{ 65422,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 58,6 },{ 503,9 },{ 4085,12 },{ 65423,16 },{ 65424,16 },{ 65425,16 },{ 65426,16 },{ 65427,16 },{ 65428,16 },{ 65429,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 59,6 },{ 1016,10 },{ 65430,16 },{ 65431,16 },{ 65432,16 },{ 65433,16 },{ 65434,16 },{ 65435,16 },{ 65436,16 },{ 65437,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 122,7 },{ 2039,11 },{ 65438,16 },{ 65439,16 },{ 65440,16 },{ 65441,16 },{ 65442,16 },{ 65443,16 },{ 65444,16 },{ 65445,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 123,7 },{ 4086,12 },{ 65446,16 },{ 65447,16 },{ 65448,16 },{ 65449,16 },{ 65450,16 },{ 65451,16 },{ 65452,16 },{ 65453,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 250,8 },{ 4087,12 },{ 65454,16 },{ 65455,16 },{ 65456,16 },{ 65457,16 },{ 65458,16 },{ 65459,16 },{ 65460,16 },{ 65461,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 504,9 },{ 32704,15 },{ 65462,16 },{ 65463,16 },{ 65464,16 },{ 65465,16 },{ 65466,16 },{ 65467,16 },{ 65468,16 },{ 65469,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 505,9 },{ 65470,16 },{ 65471,16 },{ 65472,16 },{ 65473,16 },{ 65474,16 },{ 65475,16 },{ 65476,16 },{ 65477,16 },{ 65478,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 506,9 },{ 65479,16 },{ 65480,16 },{ 65481,16 },{ 65482,16 },{ 65483,16 },{ 65484,16 },{ 65485,16 },{ 65486,16 },{ 65487,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 1017,10 },{ 65488,16 },{ 65489,16 },{ 65490,16 },{ 65491,16 },{ 65492,16 },{ 65493,16 },{ 65494,16 },{ 65495,16 },{ 65496,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 1018,10 },{ 65497,16 },{ 65498,16 },{ 65499,16 },{ 65500,16 },{ 65501,16 },{ 65502,16 },{ 65503,16 },{ 65504,16 },{ 65505,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 2040,11 },{ 65506,16 },{ 65507,16 },{ 65508,16 },{ 65509,16 },{ 65510,16 },{ 65511,16 },{ 65512,16 },{ 65513,16 },{ 65514,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 65515,16 },{ 65516,16 },{ 65517,16 },{ 65518,16 },{ 65519,16 },{ 65520,16 },{ 65521,16 },{ 65522,16 },{ 65523,16 },{ 65524,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 2041,11 },{ 65525,16 },{ 65526,16 },{ 65527,16 },{ 65528,16 },{ 65529,16 },{ 65530,16 },{ 65531,16 },{ 65532,16 },{ 65533,16 },{ 65534,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 }
+};
+static const unsigned short stbiw__jpg_UVAC_HT[256][2] = {
+	{ 0,2 },{ 1,2 },{ 4,3 },{ 10,4 },{ 24,5 },{ 25,5 },{ 56,6 },{ 120,7 },{ 500,9 },{ 1014,10 },{ 4084,12 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 11,4 },{ 57,6 },{ 246,8 },{ 501,9 },{ 2038,11 },{ 4085,12 },{ 65416,16 },{ 65417,16 },{ 65418,16 },{ 65419,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 26,5 },{ 247,8 },{ 1015,10 },{ 4086,12 },{ 32706,15 },{ 65420,16 },{ 65421,16 },{ 65422,16 },{ 65423,16 },{ 65424,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 27,5 },{ 248,8 },{ 1016,10 },{ 4087,12 },{ 65425,16 },{ 65426,16 },{ 65427,16 },{ 65428,16 },{ 65429,16 },{ 65430,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 58,6 },{ 502,9 },{ 65431,16 },{ 65432,16 },{ 65433,16 },{ 65434,16 },{ 65435,16 },{ 65436,16 },{ 65437,16 },{ 65438,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 59,6 },{ 1017,10 },{ 65439,16 },{ 65440,16 },{ 65441,16 },{ 65442,16 },{ 65443,16 },{ 65444,16 },{ 65445,16 },{ 65446,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 121,7 },{ 2039,11 },{ 65447,16 },{ 65448,16 },{ 65449,16 },{ 65450,16 },{ 65451,16 },{ 65452,16 },{ 65453,16 },{ 65454,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 122,7 },{ 2040,11 },{ 65455,16 },{ 65456,16 },{ 65457,16 },{ 65458,16 },{ 65459,16 },{ 65460,16 },{ 65461,16 },{ 65462,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 249,8 },{ 65463,16 },{ 65464,16 },{ 65465,16 },{ 65466,16 },{ 65467,16 },{ 65468,16 },{ 65469,16 },{ 65470,16 },{ 65471,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 503,9 },{ 65472,16 },{ 65473,16 },{ 65474,16 },{ 65475,16 },{ 65476,16 },{ 65477,16 },{ 65478,16 },{ 65479,16 },{ 65480,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 504,9 },{ 65481,16 },{ 65482,16 },{ 65483,16 },{ 65484,16 },{ 65485,16 },{ 65486,16 },{ 65487,16 },{ 65488,16 },{ 65489,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 505,9 },{ 65490,16 },{ 65491,16 },{ 65492,16 },{ 65493,16 },{ 65494,16 },{ 65495,16 },{ 65496,16 },{ 65497,16 },{ 65498,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 506,9 },{ 65499,16 },{ 65500,16 },{ 65501,16 },{ 65502,16 },{ 65503,16 },{ 65504,16 },{ 65505,16 },{ 65506,16 },{ 65507,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 2041,11 },{ 65508,16 },{ 65509,16 },{ 65510,16 },{ 65511,16 },{ 65512,16 },{ 65513,16 },{ 65514,16 },{ 65515,16 },{ 65516,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 16352,14 },{ 65517,16 },{ 65518,16 },{ 65519,16 },{ 65520,16 },{ 65521,16 },{ 65522,16 },{ 65523,16 },{ 65524,16 },{ 65525,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
+	{ 1018,10 },{ 32707,15 },{ 65526,16 },{ 65527,16 },{ 65528,16 },{ 65529,16 },{ 65530,16 },{ 65531,16 },{ 65532,16 },{ 65533,16 },{ 65534,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 }
+};
+
+// Body of the DHT segment (after its 0xFF,0xC4,0x01,0xA2 header): luminance
+// tables in slot 0, chrominance tables in slot 1
+static void stbiw__jpg_writeHuffmanTables(stbi__write_context *s) {
+	s->func(s->context, (void*)(stbiw__jpg_dc_luminance_nrcodes + 1), sizeof(stbiw__jpg_dc_luminance_nrcodes) - 1);
+	s->func(s->context, (void*)stbiw__jpg_dc_luminance_values, sizeof(stbiw__jpg_dc_luminance_values));
+	stbiw__putc(s, 0x10); // HTYACinfo
+	s->func(s->context, (void*)(stbiw__jpg_ac_luminance_nrcodes + 1), sizeof(stbiw__jpg_ac_luminance_nrcodes) - 1);
+	s->func(s->context, (void*)stbiw__jpg_ac_luminance_values, sizeof(stbiw__jpg_ac_luminance_values));
+	stbiw__putc(s, 1); // HTUDCinfo
+	s->func(s->context, (void*)(stbiw__jpg_dc_chrominance_nrcodes + 1), sizeof(stbiw__jpg_dc_chrominance_nrcodes) - 1);
+	s->func(s->context, (void*)stbiw__jpg_dc_chrominance_values, sizeof(stbiw__jpg_dc_chrominance_values));
+	stbiw__putc(s, 0x11); // HTUACinfo
+	s->func(s->context, (void*)(stbiw__jpg_ac_chrominance_nrcodes + 1), sizeof(stbiw__jpg_ac_chrominance_nrcodes) - 1);
+	s->func(s->context, (void*)stbiw__jpg_ac_chrominance_values, sizeof(stbiw__jpg_ac_chrominance_values));
+}
+
 static void stbiw__jpg_calcBits(int val, unsigned short bits[2]) {
 	int tmp1 = val < 0 ? -val : val;
 	val = val < 0 ? val - 1 : val;
@@ -1252,38 +1422,22 @@ static void stbiw__jpg_calcBits(int val, unsigned short bits[2]) {
 	bits[0] = val & ((1 << bits[1]) - 1);
 }
 
-static int stbiw__jpg_processDU(stbi__write_context *s, int *bitBuf, int *bitCnt, float *CDU, float *fdtbl, int DC, const unsigned short HTDC[256][2], const unsigned short HTAC[256][2]) {
+// Huffman code one block of quantized coefficients (zigzag order), returns its DC
+static int stbiw__jpg_encodeDU(stbiw__jpg_bits *b, const int *DU, int DC, const unsigned short HTDC[256][2], const unsigned short HTAC[256][2]) {
 	const unsigned short EOB[2] = { HTAC[0x00][0], HTAC[0x00][1] };
 	const unsigned short M16zeroes[2] = { HTAC[0xF0][0], HTAC[0xF0][1] };
-	int dataOff, i, diff, end0pos;
-	int DU[64];
-
-	// DCT rows
-	for (dataOff = 0; dataOff<64; dataOff += 8) {
-		stbiw__jpg_DCT(&CDU[dataOff], &CDU[dataOff + 1], &CDU[dataOff + 2], &CDU[dataOff + 3], &CDU[dataOff + 4], &CDU[dataOff + 5], &CDU[dataOff + 6], &CDU[dataOff + 7]);
-	}
-	// DCT columns
-	for (dataOff = 0; dataOff<8; ++dataOff) {
-		stbiw__jpg_DCT(&CDU[dataOff], &CDU[dataOff + 8], &CDU[dataOff + 16], &CDU[dataOff + 24], &CDU[dataOff + 32], &CDU[dataOff + 40], &CDU[dataOff + 48], &CDU[dataOff + 56]);
-	}
-	// Quantize/descale/zigzag the coefficients
-	for (i = 0; i<64; ++i) {
-		float v = CDU[i] * fdtbl[i];
-		// DU[stbiw__jpg_ZigZag[i]] = (int)(v < 0 ? ceilf(v - 0.5f) : floorf(v + 0.5f));
-		// ceilf() and floorf() are C99, not C89, but I /think/ they're not needed here anyway?
-		DU[stbiw__jpg_ZigZag[i]] = (int)(v < 0 ? v - 0.5f : v + 0.5f);
-	}
+	int i, diff, end0pos;
 
 	// Encode DC
 	diff = DU[0] - DC;
 	if (diff == 0) {
-		stbiw__jpg_writeBits(s, bitBuf, bitCnt, HTDC[0]);
+		stbiw__jpg_writeBits(b, HTDC[0]);
 	}
 	else {
 		unsigned short bits[2];
 		stbiw__jpg_calcBits(diff, bits);
-		stbiw__jpg_writeBits(s, bitBuf, bitCnt, HTDC[bits[1]]);
-		stbiw__jpg_writeBits(s, bitBuf, bitCnt, bits);
+		stbiw__jpg_writeBits(b, HTDC[bits[1]]);
+		stbiw__jpg_writeBits(b, bits);
 	}
 	// Encode ACs
 	end0pos = 63;
@@ -1291,7 +1445,7 @@ static int stbiw__jpg_processDU(stbi__write_context *s, int *bitBuf, int *bitCnt
 	}
 	// end0pos = first element in reverse order !=0
 	if (end0pos == 0) {
-		stbiw__jpg_writeBits(s, bitBuf, bitCnt, EOB);
+		stbiw__jpg_writeBits(b, EOB);
 		return DU[0];
 	}
 	for (i = 1; i <= end0pos; ++i) {
@@ -1305,98 +1459,226 @@ static int stbiw__jpg_processDU(stbi__write_context *s, int *bitBuf, int *bitCnt
 			int lng = nrzeroes >> 4;
 			int nrmarker;
 			for (nrmarker = 1; nrmarker <= lng; ++nrmarker)
-				stbiw__jpg_writeBits(s, bitBuf, bitCnt, M16zeroes);
+				stbiw__jpg_writeBits(b, M16zeroes);
 			nrzeroes &= 15;
 		}
 		stbiw__jpg_calcBits(DU[i], bits);
-		stbiw__jpg_writeBits(s, bitBuf, bitCnt, HTAC[(nrzeroes << 4) + bits[1]]);
-		stbiw__jpg_writeBits(s, bitBuf, bitCnt, bits);
+		stbiw__jpg_writeBits(b, HTAC[(nrzeroes << 4) + bits[1]]);
+		stbiw__jpg_writeBits(b, bits);
 	}
 	if (end0pos != 63) {
-		stbiw__jpg_writeBits(s, bitBuf, bitCnt, EOB);
+		stbiw__jpg_writeBits(b, EOB);
 	}
 	return DU[0];
 }
 
-static int stbi_write_jpg_core(stbi__write_context *s, int width, int height, int comp, const void* data, int quality) {
+static int stbiw__jpg_processDU(stbiw__jpg_bits *b, float *CDU, const float *fdtbl, int DC, const unsigned short HTDC[256][2], const unsigned short HTAC[256][2]) {
+	int dataOff, i;
+	int DU[64];
+
+	// DCT rows
+	for (dataOff = 0; dataOff<64; dataOff += 8) {
+		stbiw__jpg_DCT(&CDU[dataOff], &CDU[dataOff + 1], &CDU[dataOff + 2], &CDU[dataOff + 3], &CDU[dataOff + 4], &CDU[dataOff + 5], &CDU[dataOff + 6], &CDU[dataOff + 7]);
+	}
+	// DCT columns
+	for (dataOff = 0; dataOff<8; ++dataOff) {
+		stbiw__jpg_DCT(&CDU[dataOff], &CDU[dataOff + 8], &CDU[dataOff + 16], &CDU[dataOff + 24], &CDU[dataOff + 32], &CDU[dataOff + 40], &CDU[dataOff + 48], &CDU[dataOff + 56]);
+	}
+	// Quantize/descale/zigzag the coefficients
+	for (i = 0; i<64; ++i) {
+		float v = CDU[i] * fdtbl[i];
+		// DU[stbiw__jpg_ZigZag[i]] = (int)(v < 0 ? ceilf(v - 0.5f) : floorf(v + 0.5f));
+		// ceilf() and floorf() are C99, not C89, but I /think/ they're not needed here anyway?
+		DU[stbiw__jpg_ZigZag[i]] = (int)(v < 0 ? v - 0.5f : v + 0.5f);
+	}
+
+	return stbiw__jpg_encodeDU(b, DU, DC, HTDC, HTAC);
+}
+
+// Everything needed to code a run of MCU rows of the image
+typedef struct
+{
+	const unsigned char *imageData; // starts at row firstRow (0 unless the rows come in bands)
+	int firstRow;
+	int width, height, comp;
+	int subsample, buffered, flip;
+	const float *fdtbl_Y, *fdtbl_UV;
+	const unsigned short(*YDC_HT)[2], (*YAC_HT)[2], (*UVDC_HT)[2], (*UVAC_HT)[2];
+} stbiw__jpg_image;
+
+// Codes the MCU rows covering pixel rows [y0, y1), carrying the DC predictors in DC[3]
+static void stbiw__jpg_encodeMCURows(stbiw__jpg_bits *bits, const stbiw__jpg_image *img, int y0, int y1, int DC[3]) {
+	const unsigned char *imageData = img->imageData;
+	int width = img->width, height = img->height, comp = img->comp;
+	const float *fdtbl_Y = img->fdtbl_Y, *fdtbl_UV = img->fdtbl_UV;
+	int DCY = DC[0], DCU = DC[1], DCV = DC[2];
+	// comp == 2 is grey+alpha (alpha is ignored)
+	int ofsG = comp > 2 ? 1 : 0, ofsB = comp > 2 ? 2 : 0;
+	int x, y, pos, row, col;
+	if (y1 > height) {
+		y1 = height;
+	}
+	if (img->subsample) {
+		// 16x16 MCUs: four luma blocks followed by one 2x2 averaged block per chroma plane
+		for (y = y0; y < y1; y += 16) {
+			for (x = 0; x < width; x += 16) {
+				float YDU[256], UDU[256], VDU[256];
+				float blockDU[64], subU[64], subV[64];
+				int yy, xx, blk;
+				for (row = y, pos = 0; row < y + 16; ++row) {
+					// past the last row or column, repeat the edge pixels
+					int clamped_row = row < height ? row : height - 1;
+					int base_p = ((img->flip ? height - 1 - clamped_row : clamped_row) - img->firstRow)*width*comp;
+					for (col = x; col < x + 16; ++col, ++pos) {
+						int p = base_p + (col < width ? col : width - 1)*comp;
+						float r = imageData[p + 0];
+						float g = imageData[p + ofsG];
+						float b = imageData[p + ofsB];
+						YDU[pos] = +0.29900f*r + 0.58700f*g + 0.11400f*b - 128;
+						UDU[pos] = -0.16874f*r - 0.33126f*g + 0.50000f*b;
+						VDU[pos] = +0.50000f*r - 0.41869f*g - 0.08131f*b;
+					}
+				}
+				for (blk = 0; blk < 4; ++blk) {
+					const float *src = YDU + (blk >> 1) * 128 + (blk & 1) * 8;
+					for (yy = 0, pos = 0; yy < 8; ++yy) {
+						for (xx = 0; xx < 8; ++xx, ++pos) {
+							blockDU[pos] = src[yy * 16 + xx];
+						}
+					}
+					DCY = stbiw__jpg_processDU(bits, blockDU, fdtbl_Y, DCY, img->YDC_HT, img->YAC_HT);
+				}
+				for (yy = 0, pos = 0; yy < 8; ++yy) {
+					for (xx = 0; xx < 8; ++xx, ++pos) {
+						int j = yy * 32 + xx * 2;
+						subU[pos] = (UDU[j + 0] + UDU[j + 1] + UDU[j + 16] + UDU[j + 17]) * 0.25f;
+						subV[pos] = (VDU[j + 0] + VDU[j + 1] + VDU[j + 16] + VDU[j + 17]) * 0.25f;
+					}
+				}
+				DCU = stbiw__jpg_processDU(bits, subU, fdtbl_UV, DCU, img->UVDC_HT, img->UVAC_HT);
+				DCV = stbiw__jpg_processDU(bits, subV, fdtbl_UV, DCV, img->UVDC_HT, img->UVAC_HT);
+			}
+		}
+	}
+	else for (y = y0; y < y1; y += 8) {
+		for (x = 0; x < width; x += 8) {
+			float YDU[64], UDU[64], VDU[64];
+			for (row = y, pos = 0; row < y + 8; ++row) {
+				for (col = x; col < x + 8; ++col, ++pos) {
+					int p = ((img->flip ? height - 1 - row : row) - img->firstRow)*width*comp + col * comp;
+					float r, g, b;
+					if (row >= height) {
+						p -= width * comp*(row + 1 - height);
+					}
+					if (col >= width) {
+						p -= comp * (col + 1 - width);
+					}
+
+					r = imageData[p + 0];
+					g = imageData[p + ofsG];
+					b = imageData[p + ofsB];
+					YDU[pos] = +0.29900f*r + 0.58700f*g + 0.11400f*b - 128;
+					UDU[pos] = -0.16874f*r - 0.33126f*g + 0.50000f*b;
+					VDU[pos] = +0.50000f*r - 0.41869f*g - 0.08131f*b;
+				}
+			}
+
+			DCY = stbiw__jpg_processDU(bits, YDU, fdtbl_Y, DCY, img->YDC_HT, img->YAC_HT);
+			DCU = stbiw__jpg_processDU(bits, UDU, fdtbl_UV, DCU, img->UVDC_HT, img->UVAC_HT);
+			DCV = stbiw__jpg_processDU(bits, VDU, fdtbl_UV, DCV, img->UVDC_HT, img->UVAC_HT);
+		}
+	}
+
+	DC[0] = DCY;
+	DC[1] = DCU;
+	DC[2] = DCV;
+}
+
+// Codes the MCU rows covering pixel rows [y0, y1), starting from fresh DC predictors,
+// and pads the last byte with 1 bits
+static void stbiw__jpg_encodeRows(stbiw__jpg_bits *bits, const stbiw__jpg_image *img, int y0, int y1) {
+	static const unsigned short fillBits[] = { 0x7F, 7 };
+	int DC[3] = { 0, 0, 0 };
+	stbiw__jpg_encodeMCURows(bits, img, y0, y1, DC);
+
+	// Do the bit alignment of the EOI or RST marker
+	stbiw__jpg_writeBits(bits, fillBits);
+}
+
+// A restart strip is coded into its own memory buffer
+typedef struct
+{
+	unsigned char *data;
+	int len, cap;
+	int failed;
+} stbiw__jpg_strip;
+
+typedef struct
+{
+	const stbiw__jpg_image *img;
+	int stripHeight;
+	int nStrips;
+	stbiw__jpg_strip *strips;
+} stbiw__jpg_job;
+
+static void stbiw__jpg_stripWrite(void *context, void *data, int size) {
+	stbiw__jpg_strip *strip = (stbiw__jpg_strip *)context;
+	if (strip->failed) {
+		return;
+	}
+	if (strip->len + size > strip->cap) {
+		int newCap = strip->cap ? strip->cap * 2 : 16384;
+		unsigned char *newData;
+		while (newCap < strip->len + size) {
+			newCap *= 2;
+		}
+		newData = (unsigned char *)STBIW_REALLOC_SIZED(strip->data, strip->cap, newCap);
+		if (!newData) {
+			strip->failed = 1;
+			return;
+		}
+		strip->data = newData;
+		strip->cap = newCap;
+	}
+	memcpy(strip->data + strip->len, data, size);
+	strip->len += size;
+}
+
+static void stbiw__jpg_encodeStrip(void *pData, int iStrip) {
+	stbiw__jpg_job *job = (stbiw__jpg_job *)pData;
+	stbiw__jpg_strip *strip = &job->strips[iStrip];
+	stbi__write_context s;
+	stbiw__jpg_bits bits;
+	stbi__start_write_callbacks(&s, stbiw__jpg_stripWrite, strip);
+	bits.s = &s;
+	bits.bitBuf = 0;
+	bits.bitCnt = 0;
+	bits.out = job->img->buffered ? (unsigned char *)STBIW_MALLOC(STBIW__JPG_OUT_SIZE) : 0;
+	bits.outLen = 0;
+	stbiw__jpg_encodeRows(&bits, job->img, iStrip * job->stripHeight, (iStrip + 1) * job->stripHeight);
+	stbiw__jpg_flushOut(&bits);
+	STBIW_FREE(bits.out);
+}
+
+static void stbiw__jpg_freeStrips(stbiw__jpg_job *job) {
+	int i;
+	for (i = 0; i < job->nStrips; ++i) {
+		STBIW_FREE(job->strips[i].data);
+	}
+	STBIW_FREE(job->strips);
+}
+
+// Scales the standard quantization tables for quality (1..100, 0 for the default) into
+// zigzag ordered YTable/UVTable, and the matching forward DCT scale factors
+static void stbiw__jpg_initTables(int quality, unsigned char YTable[64], unsigned char UVTable[64], float fdtbl_Y[64], float fdtbl_UV[64]) {
 	// Constants that don't pollute global namespace
-	static const unsigned char std_dc_luminance_nrcodes[] = { 0,0,1,5,1,1,1,1,1,1,0,0,0,0,0,0,0 };
-	static const unsigned char std_dc_luminance_values[] = { 0,1,2,3,4,5,6,7,8,9,10,11 };
-	static const unsigned char std_ac_luminance_nrcodes[] = { 0,0,2,1,3,3,2,4,3,5,5,4,4,0,0,1,0x7d };
-	static const unsigned char std_ac_luminance_values[] = {
-		0x01,0x02,0x03,0x00,0x04,0x11,0x05,0x12,0x21,0x31,0x41,0x06,0x13,0x51,0x61,0x07,0x22,0x71,0x14,0x32,0x81,0x91,0xa1,0x08,
-		0x23,0x42,0xb1,0xc1,0x15,0x52,0xd1,0xf0,0x24,0x33,0x62,0x72,0x82,0x09,0x0a,0x16,0x17,0x18,0x19,0x1a,0x25,0x26,0x27,0x28,
-		0x29,0x2a,0x34,0x35,0x36,0x37,0x38,0x39,0x3a,0x43,0x44,0x45,0x46,0x47,0x48,0x49,0x4a,0x53,0x54,0x55,0x56,0x57,0x58,0x59,
-		0x5a,0x63,0x64,0x65,0x66,0x67,0x68,0x69,0x6a,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7a,0x83,0x84,0x85,0x86,0x87,0x88,0x89,
-		0x8a,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9a,0xa2,0xa3,0xa4,0xa5,0xa6,0xa7,0xa8,0xa9,0xaa,0xb2,0xb3,0xb4,0xb5,0xb6,
-		0xb7,0xb8,0xb9,0xba,0xc2,0xc3,0xc4,0xc5,0xc6,0xc7,0xc8,0xc9,0xca,0xd2,0xd3,0xd4,0xd5,0xd6,0xd7,0xd8,0xd9,0xda,0xe1,0xe2,
-		0xe3,0xe4,0xe5,0xe6,0xe7,0xe8,0xe9,0xea,0xf1,0xf2,0xf3,0xf4,0xf5,0xf6,0xf7,0xf8,0xf9,0xfa
-	};
-	static const unsigned char std_dc_chrominance_nrcodes[] = { 0,0,3,1,1,1,1,1,1,1,1,1,0,0,0,0,0 };
-	static const unsigned char std_dc_chrominance_values[] = { 0,1,2,3,4,5,6,7,8,9,10,11 };
-	static const unsigned char std_ac_chrominance_nrcodes[] = { 0,0,2,1,2,4,4,3,4,7,5,4,4,0,1,2,0x77 };
-	static const unsigned char std_ac_chrominance_values[] = {
-		0x00,0x01,0x02,0x03,0x11,0x04,0x05,0x21,0x31,0x06,0x12,0x41,0x51,0x07,0x61,0x71,0x13,0x22,0x32,0x81,0x08,0x14,0x42,0x91,
-		0xa1,0xb1,0xc1,0x09,0x23,0x33,0x52,0xf0,0x15,0x62,0x72,0xd1,0x0a,0x16,0x24,0x34,0xe1,0x25,0xf1,0x17,0x18,0x19,0x1a,0x26,
-		0x27,0x28,0x29,0x2a,0x35,0x36,0x37,0x38,0x39,0x3a,0x43,0x44,0x45,0x46,0x47,0x48,0x49,0x4a,0x53,0x54,0x55,0x56,0x57,0x58,
-		0x59,0x5a,0x63,0x64,0x65,0x66,0x67,0x68,0x69,0x6a,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7a,0x82,0x83,0x84,0x85,0x86,0x87,
-		0x88,0x89,0x8a,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9a,0xa2,0xa3,0xa4,0xa5,0xa6,0xa7,0xa8,0xa9,0xaa,0xb2,0xb3,0xb4,
-		0xb5,0xb6,0xb7,0xb8,0xb9,0xba,0xc2,0xc3,0xc4,0xc5,0xc6,0xc7,0xc8,0xc9,0xca,0xd2,0xd3,0xd4,0xd5,0xd6,0xd7,0xd8,0xd9,0xda,
-		0xe2,0xe3,0xe4,0xe5,0xe6,0xe7,0xe8,0xe9,0xea,0xf2,0xf3,0xf4,0xf5,0xf6,0xf7,0xf8,0xf9,0xfa
-	};
-	// Huffman tables
-	static const unsigned short YDC_HT[256][2] = { { 0,2 },{ 2,3 },{ 3,3 },{ 4,3 },{ 5,3 },{ 6,3 },{ 14,4 },{ 30,5 },{ 62,6 },{ 126,7 },{ 254,8 },{ 510,9 } };
-	static const unsigned short UVDC_HT[256][2] = { { 0,2 },{ 1,2 },{ 2,2 },{ 6,3 },{ 14,4 },{ 30,5 },{ 62,6 },{ 126,7 },{ 254,8 },{ 510,9 },{ 1022,10 },{ 2046,11 } };
-	static const unsigned short YAC_HT[256][2] = {
-		{ 10,4 },{ 0,2 },{ 1,2 },{ 4,3 },{ 11,4 },{ 26,5 },{ 120,7 },{ 248,8 },{ 1014,10 },{ 65410,16 },{ 65411,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 12,4 },{ 27,5 },{ 121,7 },{ 502,9 },{ 2038,11 },{ 65412,16 },{ 65413,16 },{ 65414,16 },{ 65415,16 },{ 65416,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 28,5 },{ 249,8 },{ 1015,10 },{ 4084,12 },{ 65417,16 },{ 65418,16 },{ 65419,16 },{ 65420,16 },{ 65421,16 },{ 65422,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 58,6 },{ 503,9 },{ 4085,12 },{ 65423,16 },{ 65424,16 },{ 65425,16 },{ 65426,16 },{ 65427,16 },{ 65428,16 },{ 65429,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 59,6 },{ 1016,10 },{ 65430,16 },{ 65431,16 },{ 65432,16 },{ 65433,16 },{ 65434,16 },{ 65435,16 },{ 65436,16 },{ 65437,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 122,7 },{ 2039,11 },{ 65438,16 },{ 65439,16 },{ 65440,16 },{ 65441,16 },{ 65442,16 },{ 65443,16 },{ 65444,16 },{ 65445,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 123,7 },{ 4086,12 },{ 65446,16 },{ 65447,16 },{ 65448,16 },{ 65449,16 },{ 65450,16 },{ 65451,16 },{ 65452,16 },{ 65453,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 250,8 },{ 4087,12 },{ 65454,16 },{ 65455,16 },{ 65456,16 },{ 65457,16 },{ 65458,16 },{ 65459,16 },{ 65460,16 },{ 65461,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 504,9 },{ 32704,15 },{ 65462,16 },{ 65463,16 },{ 65464,16 },{ 65465,16 },{ 65466,16 },{ 65467,16 },{ 65468,16 },{ 65469,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 505,9 },{ 65470,16 },{ 65471,16 },{ 65472,16 },{ 65473,16 },{ 65474,16 },{ 65475,16 },{ 65476,16 },{ 65477,16 },{ 65478,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 506,9 },{ 65479,16 },{ 65480,16 },{ 65481,16 },{ 65482,16 },{ 65483,16 },{ 65484,16 },{ 65485,16 },{ 65486,16 },{ 65487,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 1017,10 },{ 65488,16 },{ 65489,16 },{ 65490,16 },{ 65491,16 },{ 65492,16 },{ 65493,16 },{ 65494,16 },{ 65495,16 },{ 65496,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 1018,10 },{ 65497,16 },{ 65498,16 },{ 65499,16 },{ 65500,16 },{ 65501,16 },{ 65502,16 },{ 65503,16 },{ 65504,16 },{ 65505,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 2040,11 },{ 65506,16 },{ 65507,16 },{ 65508,16 },{ 65509,16 },{ 65510,16 },{ 65511,16 },{ 65512,16 },{ 65513,16 },{ 65514,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 65515,16 },{ 65516,16 },{ 65517,16 },{ 65518,16 },{ 65519,16 },{ 65520,16 },{ 65521,16 },{ 65522,16 },{ 65523,16 },{ 65524,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 2041,11 },{ 65525,16 },{ 65526,16 },{ 65527,16 },{ 65528,16 },{ 65529,16 },{ 65530,16 },{ 65531,16 },{ 65532,16 },{ 65533,16 },{ 65534,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 }
-	};
-	static const unsigned short UVAC_HT[256][2] = {
-		{ 0,2 },{ 1,2 },{ 4,3 },{ 10,4 },{ 24,5 },{ 25,5 },{ 56,6 },{ 120,7 },{ 500,9 },{ 1014,10 },{ 4084,12 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 11,4 },{ 57,6 },{ 246,8 },{ 501,9 },{ 2038,11 },{ 4085,12 },{ 65416,16 },{ 65417,16 },{ 65418,16 },{ 65419,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 26,5 },{ 247,8 },{ 1015,10 },{ 4086,12 },{ 32706,15 },{ 65420,16 },{ 65421,16 },{ 65422,16 },{ 65423,16 },{ 65424,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 27,5 },{ 248,8 },{ 1016,10 },{ 4087,12 },{ 65425,16 },{ 65426,16 },{ 65427,16 },{ 65428,16 },{ 65429,16 },{ 65430,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 58,6 },{ 502,9 },{ 65431,16 },{ 65432,16 },{ 65433,16 },{ 65434,16 },{ 65435,16 },{ 65436,16 },{ 65437,16 },{ 65438,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 59,6 },{ 1017,10 },{ 65439,16 },{ 65440,16 },{ 65441,16 },{ 65442,16 },{ 65443,16 },{ 65444,16 },{ 65445,16 },{ 65446,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 121,7 },{ 2039,11 },{ 65447,16 },{ 65448,16 },{ 65449,16 },{ 65450,16 },{ 65451,16 },{ 65452,16 },{ 65453,16 },{ 65454,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 122,7 },{ 2040,11 },{ 65455,16 },{ 65456,16 },{ 65457,16 },{ 65458,16 },{ 65459,16 },{ 65460,16 },{ 65461,16 },{ 65462,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 249,8 },{ 65463,16 },{ 65464,16 },{ 65465,16 },{ 65466,16 },{ 65467,16 },{ 65468,16 },{ 65469,16 },{ 65470,16 },{ 65471,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 503,9 },{ 65472,16 },{ 65473,16 },{ 65474,16 },{ 65475,16 },{ 65476,16 },{ 65477,16 },{ 65478,16 },{ 65479,16 },{ 65480,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 504,9 },{ 65481,16 },{ 65482,16 },{ 65483,16 },{ 65484,16 },{ 65485,16 },{ 65486,16 },{ 65487,16 },{ 65488,16 },{ 65489,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 505,9 },{ 65490,16 },{ 65491,16 },{ 65492,16 },{ 65493,16 },{ 65494,16 },{ 65495,16 },{ 65496,16 },{ 65497,16 },{ 65498,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 506,9 },{ 65499,16 },{ 65500,16 },{ 65501,16 },{ 65502,16 },{ 65503,16 },{ 65504,16 },{ 65505,16 },{ 65506,16 },{ 65507,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 2041,11 },{ 65508,16 },{ 65509,16 },{ 65510,16 },{ 65511,16 },{ 65512,16 },{ 65513,16 },{ 65514,16 },{ 65515,16 },{ 65516,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 16352,14 },{ 65517,16 },{ 65518,16 },{ 65519,16 },{ 65520,16 },{ 65521,16 },{ 65522,16 },{ 65523,16 },{ 65524,16 },{ 65525,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },
-	{ 1018,10 },{ 32707,15 },{ 65526,16 },{ 65527,16 },{ 65528,16 },{ 65529,16 },{ 65530,16 },{ 65531,16 },{ 65532,16 },{ 65533,16 },{ 65534,16 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 },{ 0,0 }
-	};
 	static const int YQT[] = { 16,11,10,16,24,40,51,61,12,12,14,19,26,58,60,55,14,13,16,24,40,57,69,56,14,17,22,29,51,87,80,62,18,22,
 		37,56,68,109,103,77,24,35,55,64,81,104,113,92,49,64,78,87,103,121,120,101,72,92,95,98,112,100,103,99 };
 	static const int UVQT[] = { 17,18,24,47,99,99,99,99,18,21,26,66,99,99,99,99,24,26,56,99,99,99,99,99,47,66,99,99,99,99,99,99,
 		99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99,99 };
 	static const float aasf[] = { 1.0f * 2.828427125f, 1.387039845f * 2.828427125f, 1.306562965f * 2.828427125f, 1.175875602f * 2.828427125f,
 		1.0f * 2.828427125f, 0.785694958f * 2.828427125f, 0.541196100f * 2.828427125f, 0.275899379f * 2.828427125f };
-
 	int row, col, i, k;
-	float fdtbl_Y[64], fdtbl_UV[64];
-	unsigned char YTable[64], UVTable[64];
-
-	if (!data || !width || !height || comp > 4 || comp < 1) {
-		return 0;
-	}
 
 	quality = quality ? quality : 90;
 	quality = quality < 1 ? 1 : quality > 100 ? 100 : quality;
@@ -1415,74 +1697,233 @@ static int stbi_write_jpg_core(stbi__write_context *s, int width, int height, in
 			fdtbl_UV[k] = 1 / (UVTable[stbiw__jpg_ZigZag[k]] * aasf[row] * aasf[col]);
 		}
 	}
+}
 
-	// Write Headers
-	{
-		static const unsigned char head0[] = { 0xFF,0xD8,0xFF,0xE0,0,0x10,'J','F','I','F',0,1,1,0,0,1,0,1,0,0,0xFF,0xDB,0,0x84,0 };
-		static const unsigned char head2[] = { 0xFF,0xDA,0,0xC,3,1,0,2,0x11,3,0x11,0,0x3F,0 };
-		const unsigned char head1[] = { 0xFF,0xC0,0,0x11,8,(unsigned char)(height >> 8),STBIW_UCHAR(height),(unsigned char)(width >> 8),STBIW_UCHAR(width),
-			3,1,0x11,0,2,0x11,1,3,0x11,1,0xFF,0xC4,0x01,0xA2,0 };
-		s->func(s->context, (void*)head0, sizeof(head0));
-		s->func(s->context, (void*)YTable, sizeof(YTable));
-		stbiw__putc(s, 1);
-		s->func(s->context, UVTable, sizeof(UVTable));
-		s->func(s->context, (void*)head1, sizeof(head1));
-		s->func(s->context, (void*)(std_dc_luminance_nrcodes + 1), sizeof(std_dc_luminance_nrcodes) - 1);
-		s->func(s->context, (void*)std_dc_luminance_values, sizeof(std_dc_luminance_values));
-		stbiw__putc(s, 0x10); // HTYACinfo
-		s->func(s->context, (void*)(std_ac_luminance_nrcodes + 1), sizeof(std_ac_luminance_nrcodes) - 1);
-		s->func(s->context, (void*)std_ac_luminance_values, sizeof(std_ac_luminance_values));
-		stbiw__putc(s, 1); // HTUDCinfo
-		s->func(s->context, (void*)(std_dc_chrominance_nrcodes + 1), sizeof(std_dc_chrominance_nrcodes) - 1);
-		s->func(s->context, (void*)std_dc_chrominance_values, sizeof(std_dc_chrominance_values));
-		stbiw__putc(s, 0x11); // HTUACinfo
-		s->func(s->context, (void*)(std_ac_chrominance_nrcodes + 1), sizeof(std_ac_chrominance_nrcodes) - 1);
-		s->func(s->context, (void*)std_ac_chrominance_values, sizeof(std_ac_chrominance_values));
-		s->func(s->context, (void*)head2, sizeof(head2));
-	}
-
-	// Encode 8x8 macroblocks
-	{
-		static const unsigned short fillBits[] = { 0x7F, 7 };
-		const unsigned char *imageData = (const unsigned char *)data;
-		int DCY = 0, DCU = 0, DCV = 0;
-		int bitBuf = 0, bitCnt = 0;
-		// comp == 2 is grey+alpha (alpha is ignored)
-		int ofsG = comp > 2 ? 1 : 0, ofsB = comp > 2 ? 2 : 0;
-		int x, y, pos;
-		for (y = 0; y < height; y += 8) {
-			for (x = 0; x < width; x += 8) {
-				float YDU[64], UDU[64], VDU[64];
-				for (row = y, pos = 0; row < y + 8; ++row) {
-					for (col = x; col < x + 8; ++col, ++pos) {
-						int p = (stbi__flip_vertically_on_write ? height - 1 - row : row)*width*comp + col * comp;
-						float r, g, b;
-						if (row >= height) {
-							p -= width * comp*(row + 1 - height);
-						}
-						if (col >= width) {
-							p -= comp * (col + 1 - width);
-						}
+// Writes everything from SOI up to and including the SOS header
+static void stbiw__jpg_writeHeaders(stbi__write_context *s, int width, int height, int subsample, const unsigned char YTable[64], const unsigned char UVTable[64], int restartInterval) {
+	static const unsigned char head0[] = { 0xFF,0xD8,0xFF,0xE0,0,0x10,'J','F','I','F',0,1,1,0,0,1,0,1,0,0,0xFF,0xDB,0,0x84,0 };
+	static const unsigned char head2[] = { 0xFF,0xDA,0,0xC,3,1,0,2,0x11,3,0x11,0,0x3F,0 };
+	const unsigned char head1[] = { 0xFF,0xC0,0,0x11,8,(unsigned char)(height >> 8),STBIW_UCHAR(height),(unsigned char)(width >> 8),STBIW_UCHAR(width),
+		3,1,(unsigned char)(subsample ? 0x22 : 0x11),0,2,0x11,1,3,0x11,1,0xFF,0xC4,0x01,0xA2,0 };
+	const unsigned char dri[] = { 0xFF,0xDD,0,4,(unsigned char)(restartInterval >> 8),STBIW_UCHAR(restartInterval) };
+	s->func(s->context, (void*)head0, sizeof(head0));
+	s->func(s->context, (void*)YTable, 64);
+	stbiw__putc(s, 1);
+	s->func(s->context, (void*)UVTable, 64);
+	s->func(s->context, (void*)head1, sizeof(head1));
+	stbiw__jpg_writeHuffmanTables(s);
+	if (restartInterval) {
+		s->func(s->context, (void*)dri, sizeof(dri));
+	}
+	s->func(s->context, (void*)head2, sizeof(head2));
+}
 
-						r = imageData[p + 0];
-						g = imageData[p + ofsG];
-						b = imageData[p + ofsB];
-						YDU[pos] = +0.29900f*r + 0.58700f*g + 0.11400f*b - 128;
-						UDU[pos] = -0.16874f*r - 0.33126f*g + 0.50000f*b;
-						VDU[pos] = +0.50000f*r - 0.41869f*g - 0.08131f*b;
+// Fills in img for coding the rows of a width x height image with the given tables
+static void stbiw__jpg_initImage(stbiw__jpg_image *img, int width, int height, int comp, int subsample, int buffered, const float *fdtbl_Y, const float *fdtbl_UV) {
+	img->imageData = 0;
+	img->firstRow = 0;
+	img->width = width;
+	img->height = height;
+	img->comp = comp;
+	img->subsample = subsample;
+	img->buffered = buffered;
+	img->flip = 0;
+	img->fdtbl_Y = fdtbl_Y;
+	img->fdtbl_UV = fdtbl_UV;
+	img->YDC_HT = stbiw__jpg_YDC_HT;
+	img->YAC_HT = stbiw__jpg_YAC_HT;
+	img->UVDC_HT = stbiw__jpg_UVDC_HT;
+	img->UVAC_HT = stbiw__jpg_UVAC_HT;
+}
+
+static int stbi_write_jpg_core(stbi__write_context *s, int width, int height, int comp, const void* data, int quality, int subsample, int buffered, int restartRows) {
+	int i;
+	float fdtbl_Y[64], fdtbl_UV[64];
+	unsigned char YTable[64], UVTable[64];
+	stbiw__jpg_image img;
+	stbiw__jpg_job job;
+	int restartInterval = 0;
+
+	if (!data || !width || !height || comp > 4 || comp < 1) {
+		return 0;
+	}
+
+	stbiw__jpg_initTables(quality, YTable, UVTable, fdtbl_Y, fdtbl_UV);
+	stbiw__jpg_initImage(&img, width, height, comp, subsample, buffered, fdtbl_Y, fdtbl_UV);
+	img.imageData = (const unsigned char *)data;
+	img.flip = stbi__flip_vertically_on_write;
+
+	// Code the restart strips up front (possibly in parallel) so that a failure can
+	// still fall back to a single scan before anything has been written out
+	if (restartRows > 0) {
+		int mcuSize = subsample ? 16 : 8;
+		int mcusPerRow = (width + mcuSize - 1) / mcuSize;
+		int mcuRows = (height + mcuSize - 1) / mcuSize;
+		if (restartRows > 65535 / mcusPerRow) {
+			restartRows = 65535 / mcusPerRow;
+		}
+		if (restartRows < 1 || restartRows >= mcuRows) {
+			restartRows = 0;
+		}
+		else {
+			job.img = &img;
+			job.stripHeight = restartRows * mcuSize;
+			job.nStrips = (mcuRows + restartRows - 1) / restartRows;
+			job.strips = (stbiw__jpg_strip *)STBIW_MALLOC(job.nStrips * sizeof(stbiw__jpg_strip));
+			if (job.strips) {
+				memset(job.strips, 0, job.nStrips * sizeof(stbiw__jpg_strip));
+				STBIW_PARALLEL(job.nStrips, stbiw__jpg_encodeStrip, &job);
+				for (i = 0; i < job.nStrips; ++i) {
+					if (job.strips[i].failed) {
+						break;
 					}
 				}
+				if (i < job.nStrips) {
+					stbiw__jpg_freeStrips(&job);
+					restartRows = 0;
+				}
+			}
+			else {
+				restartRows = 0;
+			}
+		}
+		restartInterval = restartRows * mcusPerRow;
+	}
 
-				DCY = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, YDU, fdtbl_Y, DCY, YDC_HT, YAC_HT);
-				DCU = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, UDU, fdtbl_UV, DCU, UVDC_HT, UVAC_HT);
-				DCV = stbiw__jpg_processDU(s, &bitBuf, &bitCnt, VDU, fdtbl_UV, DCV, UVDC_HT, UVAC_HT);
+	// Write Headers
+	stbiw__jpg_writeHeaders(s, width, height, subsample, YTable, UVTable, restartInterval);
+
+	if (restartInterval) {
+		// Strips are byte aligned, separated by RST0..RST7 markers in turn
+		for (i = 0; i < job.nStrips; ++i) {
+			if (i > 0) {
+				stbiw__putc(s, 0xFF);
+				stbiw__putc(s, (unsigned char)(0xD0 + ((i - 1) & 7)));
 			}
+			s->func(s->context, job.strips[i].data, job.strips[i].len);
 		}
+		stbiw__jpg_freeStrips(&job);
+	}
+	else {
+		// Encode 8x8 macroblocks
+		stbiw__jpg_bits bits;
+		bits.s = s;
+		bits.bitBuf = 0;
+		bits.bitCnt = 0;
+		bits.out = buffered ? (unsigned char *)STBIW_MALLOC(STBIW__JPG_OUT_SIZE) : 0;
+		bits.outLen = 0;
+		stbiw__jpg_encodeRows(&bits, &img, 0, height);
+		stbiw__jpg_flushOut(&bits);
+		STBIW_FREE(bits.out);
+	}
 
-		// Do the bit alignment of the EOI marker
-		stbiw__jpg_writeBits(s, &bitBuf, &bitCnt, fillBits);
+	// EOI
+	stbiw__putc(s, 0xFF);
+	stbiw__putc(s, 0xD9);
+
+	return 1;
+}
+
+static int stbi_write_jpg_coefficients_core(stbi__write_context *s, int width, int height, int comp, const stbi_write_jpg_component *comps, const unsigned short quant[4][64]) {
+	static const unsigned char head0[] = { 0xFF,0xD8,0xFF,0xE0,0,0x10,'J','F','I','F',0,1,1,0,0,1,0,1,0,0 };
+	static const unsigned short fillBits[] = { 0x7F, 7 };
+	int used[4] = { 0, 0, 0, 0 }, DC[3] = { 0, 0, 0 };
+	int hMax = 1, vMax = 1, mcuX, mcuY, mx, my, n, i, t, x, y;
+	int DU[64];
+	stbiw__jpg_bits bits;
+
+	if (!comps || !width || !height || (comp != 1 && comp != 3)) {
+		return 0;
+	}
+	for (n = 0; n < comp; ++n) {
+		if (comps[n].tq < 0 || comps[n].tq > 3 || !comps[n].coeff) {
+			return 0;
+		}
+		used[comps[n].tq] = 1;
+		hMax = comps[n].h > hMax ? comps[n].h : hMax;
+		vMax = comps[n].v > vMax ? comps[n].v : vMax;
+	}
+	if (comp == 1) {
+		// a single component scan is never interleaved, blocks go in raster order
+		hMax = vMax = 1;
+	}
+
+	// Write Headers
+	s->func(s->context, (void*)head0, sizeof(head0));
+	for (t = 0; t < 4; ++t) {
+		unsigned short zz[64];
+		int sixteen = 0;
+		if (!used[t]) {
+			continue;
+		}
+		for (i = 0; i < 64; ++i) {
+			zz[stbiw__jpg_ZigZag[i]] = quant[t][i];
+			sixteen |= quant[t][i] > 255;
+		}
+		stbiw__putc(s, 0xFF);
+		stbiw__putc(s, 0xDB);
+		stbiw__putc(s, 0);
+		stbiw__putc(s, (unsigned char)(3 + (sixteen ? 128 : 64)));
+		stbiw__putc(s, (unsigned char)((sixteen << 4) | t));
+		for (i = 0; i < 64; ++i) {
+			if (sixteen) {
+				stbiw__putc(s, (unsigned char)(zz[i] >> 8));
+			}
+			stbiw__putc(s, STBIW_UCHAR(zz[i]));
+		}
+	}
+	{
+		const unsigned char sof[] = { 0xFF,0xC0,0,(unsigned char)(8 + 3 * comp),8,(unsigned char)(height >> 8),STBIW_UCHAR(height),
+			(unsigned char)(width >> 8),STBIW_UCHAR(width),(unsigned char)comp };
+		const unsigned char dht[] = { 0xFF,0xC4,0x01,0xA2,0 };
+		const unsigned char sos[] = { 0xFF,0xDA,0,(unsigned char)(6 + 2 * comp),(unsigned char)comp };
+		const unsigned char sosEnd[] = { 0,0x3F,0 };
+		s->func(s->context, (void*)sof, sizeof(sof));
+		for (n = 0; n < comp; ++n) {
+			stbiw__putc(s, STBIW_UCHAR(comps[n].id));
+			stbiw__putc(s, (unsigned char)(comp == 1 ? 0x11 : (comps[n].h << 4) | comps[n].v));
+			stbiw__putc(s, (unsigned char)comps[n].tq);
+		}
+		s->func(s->context, (void*)dht, sizeof(dht));
+		stbiw__jpg_writeHuffmanTables(s);
+		s->func(s->context, (void*)sos, sizeof(sos));
+		for (n = 0; n < comp; ++n) {
+			stbiw__putc(s, STBIW_UCHAR(comps[n].id));
+			stbiw__putc(s, (unsigned char)(n ? 0x11 : 0x00));
+		}
+		s->func(s->context, (void*)sosEnd, sizeof(sosEnd));
 	}
 
+	// Encode the blocks, one MCU at a time
+	bits.s = s;
+	bits.bitBuf = 0;
+	bits.bitCnt = 0;
+	bits.out = (unsigned char *)STBIW_MALLOC(STBIW__JPG_OUT_SIZE);
+	bits.outLen = 0;
+	mcuX = (width + 8 * hMax - 1) / (8 * hMax);
+	mcuY = (height + 8 * vMax - 1) / (8 * vMax);
+	for (my = 0; my < mcuY; ++my) {
+		for (mx = 0; mx < mcuX; ++mx) {
+			for (n = 0; n < comp; ++n) {
+				int h = comp == 1 ? 1 : comps[n].h;
+				int v = comp == 1 ? 1 : comps[n].v;
+				for (y = 0; y < v; ++y) {
+					for (x = 0; x < h; ++x) {
+						const short *block = comps[n].coeff + 64 * ((my * v + y) * comps[n].blocks_w + mx * h + x);
+						for (i = 0; i < 64; ++i) {
+							DU[stbiw__jpg_ZigZag[i]] = block[i];
+						}
+						DC[n] = n ? stbiw__jpg_encodeDU(&bits, DU, DC[n], stbiw__jpg_UVDC_HT, stbiw__jpg_UVAC_HT)
+							: stbiw__jpg_encodeDU(&bits, DU, DC[n], stbiw__jpg_YDC_HT, stbiw__jpg_YAC_HT);
+					}
+				}
+			}
+		}
+	}
+	stbiw__jpg_writeBits(&bits, fillBits);
+	stbiw__jpg_flushOut(&bits);
+	STBIW_FREE(bits.out);
+
 	// EOI
 	stbiw__putc(s, 0xFF);
 	stbiw__putc(s, 0xD9);
@@ -1494,7 +1935,7 @@ STBIWDEF int stbi_write_jpg_to_func(stbi_write_func *func, void *context, int x,
 {
 	stbi__write_context s;
 	stbi__start_write_callbacks(&s, func, context);
-	return stbi_write_jpg_core(&s, x, y, comp, (void *)data, quality);
+	return stbi_write_jpg_core(&s, x, y, comp, (void *)data, quality, 0, 0, 0);
 }
 
 
@@ -1503,13 +1944,137 @@ STBIWDEF int stbi_write_jpg(char const *filename, int x, int y, int comp, const
 {
 	stbi__write_context s;
 	if (stbi__start_write_file(&s, filename)) {
-		int r = stbi_write_jpg_core(&s, x, y, comp, data, quality);
+		int r = stbi_write_jpg_core(&s, x, y, comp, data, quality, 0, 0, 0);
 		stbi__end_write_file(&s);
 		return r;
 	}
 	else
 		return 0;
 }
+
+STBIWDEF int stbi_write_jpg_ext(char const *filename, int x, int y, int comp, const void *data, int quality, int subsample, int buffered, int restart_rows)
+{
+	stbi__write_context s;
+	if (stbi__start_write_file(&s, filename)) {
+		int r = stbi_write_jpg_core(&s, x, y, comp, data, quality, subsample, buffered, restart_rows);
+		stbi__end_write_file(&s);
+		return r;
+	}
+	else
+		return 0;
+}
+
+STBIWDEF int stbi_write_jpg_coefficients(char const *filename, int x, int y, int comp, const stbi_write_jpg_component *comps, const unsigned short quant[4][64])
+{
+	stbi__write_context s;
+	if (stbi__start_write_file(&s, filename)) {
+		int r = stbi_write_jpg_coefficients_core(&s, x, y, comp, comps, quant);
+		stbi__end_write_file(&s);
+		return r;
+	}
+	else
+		return 0;
+}
+
+struct stbi_write_jpg_stream
+{
+	stbi__write_context s;
+	stbiw__jpg_bits bits;
+	stbiw__jpg_image img;   // img.firstRow is the first row not coded yet
+	float fdtbl_Y[64], fdtbl_UV[64];
+	int DC[3];
+	int mcuHeight;
+	unsigned char *band;    // rows of a partly filled MCU row
+	int bandRows;
+	int failed;
+};
+
+STBIWDEF stbi_write_jpg_stream *stbi_write_jpg_stream_begin(char const *filename, int x, int y, int comp, int quality, int subsample, int buffered)
+{
+	unsigned char YTable[64], UVTable[64];
+	stbi_write_jpg_stream *st;
+
+	if (!x || !y || comp > 4 || comp < 1) {
+		return 0;
+	}
+	st = (stbi_write_jpg_stream *)STBIW_MALLOC(sizeof(stbi_write_jpg_stream));
+	if (!st) {
+		return 0;
+	}
+	memset(st, 0, sizeof(stbi_write_jpg_stream));
+	st->mcuHeight = subsample ? 16 : 8;
+	st->band = (unsigned char *)STBIW_MALLOC((size_t)st->mcuHeight * x * comp);
+	if (!st->band || !stbi__start_write_file(&st->s, filename)) {
+		STBIW_FREE(st->band);
+		STBIW_FREE(st);
+		return 0;
+	}
+
+	stbiw__jpg_initTables(quality, YTable, UVTable, st->fdtbl_Y, st->fdtbl_UV);
+	stbiw__jpg_initImage(&st->img, x, y, comp, subsample, buffered, st->fdtbl_Y, st->fdtbl_UV);
+	st->bits.s = &st->s;
+	st->bits.out = buffered ? (unsigned char *)STBIW_MALLOC(STBIW__JPG_OUT_SIZE) : 0;
+	stbiw__jpg_writeHeaders(&st->s, x, y, subsample, YTable, UVTable, 0);
+	return st;
+}
+
+STBIWDEF int stbi_write_jpg_stream_rows(stbi_write_jpg_stream *st, const void *rows, int nrows)
+{
+	const unsigned char *src = (const unsigned char *)rows;
+	size_t stride = (size_t)st->img.width * st->img.comp;
+
+	if (st->failed || nrows < 0 || st->img.firstRow + st->bandRows + nrows > st->img.height) {
+		st->failed = 1;
+		return 0;
+	}
+	while (nrows > 0) {
+		// the last MCU row may be short, its missing rows repeat the bottom one
+		int left = st->img.height - st->img.firstRow;
+		int want = left < st->mcuHeight ? left : st->mcuHeight;
+		if (!st->bandRows && nrows >= want) {
+			// whole MCU rows are coded straight from the caller's rows
+			int n = nrows == left ? nrows : nrows / st->mcuHeight * st->mcuHeight;
+			st->img.imageData = src;
+			stbiw__jpg_encodeMCURows(&st->bits, &st->img, st->img.firstRow, st->img.firstRow + n, st->DC);
+			st->img.firstRow += n;
+			src += n * stride;
+			nrows -= n;
+		}
+		else {
+			int take = want - st->bandRows < nrows ? want - st->bandRows : nrows;
+			memcpy(st->band + st->bandRows * stride, src, take * stride);
+			st->bandRows += take;
+			src += take * stride;
+			nrows -= take;
+			if (st->bandRows == want) {
+				st->img.imageData = st->band;
+				stbiw__jpg_encodeMCURows(&st->bits, &st->img, st->img.firstRow, st->img.firstRow + want, st->DC);
+				st->img.firstRow += want;
+				st->bandRows = 0;
+			}
+		}
+	}
+	return 1;
+}
+
+STBIWDEF int stbi_write_jpg_stream_end(stbi_write_jpg_stream *st)
+{
+	static const unsigned short fillBits[] = { 0x7F, 7 };
+	int ok = !st->failed && st->img.firstRow == st->img.height;
+
+	if (ok) {
+		// Do the bit alignment of the EOI marker
+		stbiw__jpg_writeBits(&st->bits, fillBits);
+		stbiw__jpg_flushOut(&st->bits);
+		stbiw__putc(&st->s, 0xFF);
+		stbiw__putc(&st->s, 0xD9);
+	}
+	stbi__end_write_file(&st->s);
+	STBIW_FREE(st->bits.out);
+	STBIW_FREE(st->band);
+	STBIW_FREE(st);
+	return ok;
+}
 #endif
 
 #endif // STB_IMAGE_WRITE_IMPLEMENTATION